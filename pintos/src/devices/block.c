@@ -27,6 +27,12 @@ get_write_cnt (struct block *block)
   return block->write_cnt;
 }
 
+unsigned long long
+get_read_cnt (struct block *block)
+{
+  return block->read_cnt;
+}
+
 /* List of all block devices. */
 static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 
@@ -126,9 +132,7 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  block_read_multi (block, sector, 1, buffer);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -139,10 +143,43 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
+  block_write_multi (block, sector, 1, buffer);
+}
+
+/* Reads the CNT consecutive sectors starting at SECTOR from BLOCK
+   into BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes, in as few device requests as the driver allows.  Counts
+   as CNT sector reads.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multi (struct block *block, block_sector_t sector, size_t cnt,
+                  void *buffer)
+{
+  ASSERT (cnt > 0);
+  check_sector (block, sector);
+  check_sector (block, sector + cnt - 1);
+  block->ops->read (block->aux, sector, cnt, buffer);
+  block->read_cnt += cnt;
+}
+
+/* Writes the CNT consecutive sectors starting at SECTOR to BLOCK
+   from BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes,
+   in as few device requests as the driver allows.  Counts as CNT
+   sector writes.  Returns after the block device has acknowledged
+   receiving the data.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multi (struct block *block, block_sector_t sector, size_t cnt,
+                   const void *buffer)
+{
+  ASSERT (cnt > 0);
   check_sector (block, sector);
+  check_sector (block, sector + cnt - 1);
   ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  block->ops->write (block->aux, sector, cnt, buffer);
+  block->write_cnt += cnt;
 }
 
 /* Returns the number of sectors in BLOCK. */
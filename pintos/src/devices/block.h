@@ -53,18 +53,24 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multi (struct block *, block_sector_t, size_t cnt, void *);
+void block_write_multi (struct block *, block_sector_t, size_t cnt,
+                        const void *);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
 /* Statistics. */
 void block_print_stats (void);
 
-/* Lower-level interface to block device drivers. */
+/* Lower-level interface to block device drivers.  READ and WRITE
+   transfer CNT consecutive sectors, CNT >= 1, starting at the given
+   one. */
 
 struct block_operations
   {
-    void (*read) (void *aux, block_sector_t, void *buffer);
-    void (*write) (void *aux, block_sector_t, const void *buffer);
+    void (*read) (void *aux, block_sector_t, size_t cnt, void *buffer);
+    void (*write) (void *aux, block_sector_t, size_t cnt,
+                   const void *buffer);
   };
 
 struct block *block_register (const char *name, enum block_type,
@@ -72,5 +78,6 @@ struct block *block_register (const char *name, enum block_type,
                               const struct block_operations *, void *aux);
 
 unsigned long long get_write_cnt (struct block *block);
+unsigned long long get_read_cnt (struct block *block);
 
 #endif /* devices/block.h */
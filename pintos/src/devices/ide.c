@@ -50,6 +50,15 @@
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
 
+/* Most sectors one READ SECTOR or WRITE SECTOR command transfers.
+   A sector count of 0 in the command stands for this many. */
+#define MAX_SECTORS_PER_CMD 256
+
+/* Ticks to wait for a command's completion interrupt before
+   giving up on it.  The ATA standards allow a disk up to 30
+   seconds to respond. */
+#define COMPLETION_TIMEOUT (30 * TIMER_FREQ)
+
 /* An ATA device. */
 struct ata_disk
   {
@@ -85,13 +94,14 @@ static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void select_sector (struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
 
 static void wait_until_idle (const struct ata_disk *);
 static bool wait_while_busy (const struct ata_disk *);
+static bool wait_for_completion (const struct ata_disk *);
 static void select_device (const struct ata_disk *);
 static void select_device_wait (const struct ata_disk *);
 
@@ -124,6 +134,7 @@ ide_init (void)
           NOT_REACHED ();
         }
       lock_init (&c->lock);
+      lock_set_name (&c->lock, "ide channel");
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
 
@@ -273,8 +284,7 @@ identify_ata_device (struct ata_disk *d)
      into our buffer. */
   select_device_wait (d);
   issue_pio_command (c, CMD_IDENTIFY_DEVICE);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
+  if (!wait_for_completion (d) || !wait_while_busy (d))
     {
       d->is_ata = false;
       return;
@@ -337,42 +347,81 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
+/* Reads CNT sectors starting at SEC_NO from disk D into BUFFER,
+   which must have room for CNT * BLOCK_SECTOR_SIZE bytes.  Up to
+   MAX_SECTORS_PER_CMD sectors are read per command; the disk
+   interrupts once for each sector as its data becomes ready.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+ide_read (void *d_, block_sector_t sec_no, size_t cnt, void *buffer_)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  uint8_t *buffer = buffer_;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
+  while (cnt > 0)
+    {
+      size_t n = cnt < MAX_SECTORS_PER_CMD ? cnt : MAX_SECTORS_PER_CMD;
+      size_t i;
+
+      select_sector (d, sec_no, n);
+      issue_pio_command (c, CMD_READ_SECTOR_RETRY);
+      for (i = 0; i < n; i++)
+        {
+          if (!wait_for_completion (d) || !wait_while_busy (d))
+            PANIC ("%s: disk read failed, sector=%"PRDSNu,
+                   d->name, sec_no + i);
+          if (i + 1 < n)
+            c->expecting_interrupt = true;
+          input_sector (c, buffer);
+          buffer += BLOCK_SECTOR_SIZE;
+        }
+      sec_no += n;
+      cnt -= n;
+    }
   lock_release (&c->lock);
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
+/* Write CNT sectors starting at SEC_NO to disk D from BUFFER,
+   which must contain CNT * BLOCK_SECTOR_SIZE bytes.  Returns after
+   the disk has acknowledged receiving the data.  Up to
+   MAX_SECTORS_PER_CMD sectors are written per command; the disk
+   interrupts once for each sector it has taken.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+ide_write (void *d_, block_sector_t sec_no, size_t cnt, const void *buffer_)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  const uint8_t *buffer = buffer_;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
+  while (cnt > 0)
+    {
+      size_t n = cnt < MAX_SECTORS_PER_CMD ? cnt : MAX_SECTORS_PER_CMD;
+      size_t i;
+
+      select_sector (d, sec_no, n);
+      issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
+      for (i = 0; i < n; i++)
+        {
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk write failed, sector=%"PRDSNu,
+                   d->name, sec_no + i);
+          if (i > 0)
+            c->expecting_interrupt = true;
+          output_sector (c, buffer);
+          if (!wait_for_completion (d))
+            PANIC ("%s: disk write failed, sector=%"PRDSNu,
+                   d->name, sec_no + i);
+          buffer += BLOCK_SECTOR_SIZE;
+        }
+      sec_no += n;
+      cnt -= n;
+    }
   lock_release (&c->lock);
 }
 
@@ -383,17 +432,19 @@ static struct block_operations ide_operations =
   };
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the number of sectors CNT, at most
+   MAX_SECTORS_PER_CMD, to the disk's sector selection registers.
+   (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= MAX_SECTORS_PER_CMD);
 
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt % MAX_SECTORS_PER_CMD);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -479,6 +530,31 @@ wait_while_busy (const struct ata_disk *d)
   return false;
 }
 
+/* Waits up to COMPLETION_TIMEOUT ticks for the completion
+   interrupt of the command last issued to disk D's channel.
+   Returns true if it arrived, false on timeout, in which case a
+   late interrupt will be reported as unexpected. */
+static bool
+wait_for_completion (const struct ata_disk *d)
+{
+  struct channel *c = d->channel;
+  enum intr_level old_level;
+  bool completed;
+
+  if (sema_down_timeout (&c->completion_wait, COMPLETION_TIMEOUT))
+    return true;
+
+  /* The interrupt may have slipped in just after the timeout. */
+  old_level = intr_disable ();
+  c->expecting_interrupt = false;
+  completed = sema_try_down (&c->completion_wait);
+  intr_set_level (old_level);
+
+  if (!completed)
+    printf ("%s: interrupt timeout\n", d->name);
+  return completed;
+}
+
 /* Program D's channel so that D is now the selected disk. */
 static void
 select_device (const struct ata_disk *d)
@@ -0,0 +1,195 @@
+#include "devices/lapic.h"
+#include <debug.h>
+#include <stddef.h>
+#include "devices/timer.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/vaddr.h"
+
+/* Interface to the local APIC, the interrupt controller built
+   into each CPU, which is also how CPUs interrupt and start one
+   another.  See [IA32-v3a] chapter 10 "Advanced Programmable
+   Interrupt Controller (APIC)". */
+
+/* Local APIC registers, as indexes into the array of 32-bit
+   words at LAPIC_VADDR.  See [IA32-v3a] table 10-1 "Local APIC
+   Register Address Map". */
+#define ID      (0x020 / 4)     /* Local APIC ID. */
+#define TPR     (0x080 / 4)     /* Task priority. */
+#define EOI     (0x0b0 / 4)     /* End of interrupt. */
+#define SVR     (0x0f0 / 4)     /* Spurious interrupt vector. */
+#define ESR     (0x280 / 4)     /* Error status. */
+#define ICR_LO  (0x300 / 4)     /* Interrupt command, bits 0...31. */
+#define ICR_HI  (0x310 / 4)     /* Interrupt command, bits 32...63. */
+#define TIMER   (0x320 / 4)     /* Local vector table: timer. */
+#define ERROR   (0x370 / 4)     /* Local vector table: error. */
+
+/* SVR bits. */
+#define SVR_ENABLE  0x00000100  /* APIC software enable. */
+
+/* Local vector table bits. */
+#define LVT_MASKED  0x00010000  /* Interrupt masked. */
+
+/* ICR_LO bits. */
+#define ICR_INIT    0x00000500  /* INIT delivery mode. */
+#define ICR_STARTUP 0x00000600  /* Start-up delivery mode. */
+#define ICR_PENDING 0x00001000  /* Delivery status: send pending. */
+#define ICR_ASSERT  0x00004000  /* Level: assert. */
+#define ICR_LEVEL   0x00008000  /* Trigger mode: level. */
+#define ICR_OTHERS  0x000c0000  /* Shorthand: all CPUs but this one. */
+
+/* Kernel virtual address of the local APIC registers.  Every CPU
+   sees its own local APIC at the same physical address, so one
+   mapping, in the top page of the address space, serves them
+   all. */
+#define LAPIC_VADDR ((void *) 0xfffff000)
+
+/* Local APIC registers, or a null pointer if not mapped. */
+static volatile uint32_t *lapic;
+
+/* Reads local APIC register REG. */
+static uint32_t
+lapic_read (int reg)
+{
+  return lapic[reg];
+}
+
+/* Writes VALUE to local APIC register REG, then waits for the
+   write to finish by reading back the ID register. */
+static void
+lapic_write (int reg, uint32_t value)
+{
+  lapic[reg] = value;
+  (void) lapic[ID];
+}
+
+/* Maps the local APIC registers, at physical address PADDR, into
+   the kernel's page directory.  Must be called before any
+   process page directory is created, since those copy the
+   kernel's mappings from init_page_dir. */
+void
+lapic_map (uintptr_t paddr)
+{
+  uint32_t *pde = &init_page_dir[pd_no (LAPIC_VADDR)];
+  uint32_t *pt;
+
+  ASSERT (lapic == NULL);
+  ASSERT (*pde == 0);
+
+  /* The registers must not be cached.  See [IA32-v3a] 10.4.1
+     "The Local APIC Block Diagram". */
+  pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  *pde = pde_create (pt);
+  pt[pt_no (LAPIC_VADDR)] = (paddr & PTE_ADDR) | PTE_P | PTE_W | PTE_PCD;
+  lapic = LAPIC_VADDR;
+}
+
+/* Enables the running CPU's local APIC.
+
+   The local APIC timer is left masked: timer ticks come from the
+   8254 PIT to the first CPU, which passes them on to the others
+   (see cpu_tick_others()).  LINT0 and LINT1 keep the settings
+   the BIOS gave them, which route the 8259A PIC's interrupts to
+   the first CPU and leave them masked on the others. */
+void
+lapic_init (void)
+{
+  ASSERT (lapic != NULL);
+
+  lapic_write (SVR, SVR_ENABLE | LAPIC_SPURIOUS);
+  lapic_write (TIMER, LVT_MASKED);
+  lapic_write (ERROR, LVT_MASKED);
+
+  /* Clear the error status, which takes back-to-back writes,
+     and any interrupt left unacknowledged.  Then accept
+     interrupts of every priority. */
+  lapic_write (ESR, 0);
+  lapic_write (ESR, 0);
+  lapic_write (EOI, 0);
+  lapic_write (TPR, 0);
+}
+
+/* Returns the running CPU's local APIC ID. */
+uint8_t
+lapic_id (void)
+{
+  ASSERT (lapic != NULL);
+  return lapic_read (ID) >> 24;
+}
+
+/* Acknowledges the interrupt being handled, so that the local
+   APIC can deliver the next one. */
+void
+lapic_eoi (void)
+{
+  lapic_write (EOI, 0);
+}
+
+/* Sends the interrupt command LO to the CPU with local APIC ID
+   APIC_ID, waiting first for any previous command to go out.
+   Interrupts must be off, so that no interrupt handler can send
+   a command between the two register writes. */
+static void
+send_command (uint8_t apic_id, uint32_t lo)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (lapic_read (ICR_LO) & ICR_PENDING)
+    asm volatile ("pause");
+  lapic_write (ICR_HI, (uint32_t) apic_id << 24);
+  lapic_write (ICR_LO, lo);
+}
+
+/* Interrupts the CPU with local APIC ID APIC_ID with interrupt
+   vector VEC. */
+void
+lapic_send_ipi (uint8_t apic_id, uint8_t vec)
+{
+  enum intr_level old_level = intr_disable ();
+  send_command (apic_id, vec);
+  intr_set_level (old_level);
+}
+
+/* Interrupts every CPU except the running one with interrupt
+   vector VEC. */
+void
+lapic_send_ipi_others (uint8_t vec)
+{
+  enum intr_level old_level = intr_disable ();
+  send_command (0, ICR_OTHERS | vec);
+  intr_set_level (old_level);
+}
+
+/* Starts the CPU with local APIC ID APIC_ID running real-mode
+   code at physical address PADDR, which must be page-aligned
+   and below 1 MB.  This is the INIT-SIPI-SIPI sequence of
+   [MP] B.4 "Application Processor Startup", which also expects
+   the delays below. */
+void
+lapic_start_ap (uint8_t apic_id, uintptr_t paddr)
+{
+  enum intr_level old_level;
+  int i;
+
+  ASSERT (paddr % PGSIZE == 0 && paddr < 0x100000);
+
+  old_level = intr_disable ();
+  send_command (apic_id, ICR_INIT | ICR_LEVEL | ICR_ASSERT);
+  intr_set_level (old_level);
+  timer_udelay (200);
+
+  old_level = intr_disable ();
+  send_command (apic_id, ICR_INIT | ICR_LEVEL);
+  intr_set_level (old_level);
+  timer_mdelay (10);
+
+  for (i = 0; i < 2; i++)
+    {
+      old_level = intr_disable ();
+      send_command (apic_id, ICR_STARTUP | (paddr >> 12));
+      intr_set_level (old_level);
+      timer_udelay (200);
+    }
+}
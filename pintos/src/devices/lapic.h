@@ -0,0 +1,18 @@
+#ifndef DEVICES_LAPIC_H
+#define DEVICES_LAPIC_H
+
+#include <stdint.h>
+
+/* Interrupt vector for spurious local APIC interrupts, which
+   need no end-of-interrupt. */
+#define LAPIC_SPURIOUS 0xff
+
+void lapic_map (uintptr_t paddr);
+void lapic_init (void);
+uint8_t lapic_id (void);
+void lapic_eoi (void);
+void lapic_send_ipi (uint8_t apic_id, uint8_t vec);
+void lapic_send_ipi_others (uint8_t vec);
+void lapic_start_ap (uint8_t apic_id, uintptr_t paddr);
+
+#endif /* devices/lapic.h */
@@ -298,23 +298,25 @@ partition_type_name (uint8_t type)
   return type_names[type] != NULL ? type_names[type] : "Unknown";
 }
 
-/* Reads sector SECTOR from partition P into BUFFER, which must
-   have room for BLOCK_SECTOR_SIZE bytes. */
+/* Reads CNT sectors starting at SECTOR from partition P into
+   BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes. */
 static void
-partition_read (void *p_, block_sector_t sector, void *buffer)
+partition_read (void *p_, block_sector_t sector, size_t cnt, void *buffer)
 {
   struct partition *p = p_;
-  block_read (p->block, p->start + sector, buffer);
+  block_read_multi (p->block, p->start + sector, cnt, buffer);
 }
 
-/* Write sector SECTOR to partition P from BUFFER, which must
-   contain BLOCK_SECTOR_SIZE bytes.  Returns after the block has
-   acknowledged receiving the data. */
+/* Write CNT sectors starting at SECTOR to partition P from BUFFER,
+   which must contain CNT * BLOCK_SECTOR_SIZE bytes.  Returns after
+   the block has acknowledged receiving the data. */
 static void
-partition_write (void *p_, block_sector_t sector, const void *buffer)
+partition_write (void *p_, block_sector_t sector, size_t cnt,
+                 const void *buffer)
 {
   struct partition *p = p_;
-  block_write (p->block, p->start + sector, buffer);
+  block_write_multi (p->block, p->start + sector, cnt, buffer);
 }
 
 static struct block_operations partition_operations =
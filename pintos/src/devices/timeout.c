@@ -0,0 +1,243 @@
+#include "devices/timeout.h"
+#include <debug.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* The timer wheel has WHEEL_LEVELS levels of WHEEL_SIZE slots.
+   A slot on level 0 holds the timeouts that expire on one
+   particular tick; a slot on level L holds the timeouts that
+   expire within one particular run of WHEEL_SIZE**L ticks.
+   Whenever level L-1 wraps around, the next slot on level L is
+   "cascaded": its timeouts are redistributed onto the lower
+   levels.  Each timeout is thus touched at most WHEEL_LEVELS
+   times between being armed and expiring.
+
+   Timeouts further out than the wheel can represent (about 46
+   hours at 100 Hz) are parked in the farthest slot and cascaded
+   again until they come into range. */
+#define WHEEL_BITS 6                            /* Bits per level. */
+#define WHEEL_SIZE (1 << WHEEL_BITS)            /* Slots per level. */
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4                          /* Number of levels. */
+#define WHEEL_MAX_DELTA ((1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1)
+
+/* Slots of the timer wheel. */
+static struct list wheel[WHEEL_LEVELS][WHEEL_SIZE];
+
+/* Next tick to be processed by timeout_tick().  Every timeout
+   expiring before this tick has already been run or deferred. */
+static int64_t wheel_time;
+
+/* Expired deferred timeouts waiting for the timeout thread, and
+   a semaphore up'd once for each timeout added to the list. */
+static struct list deferred_list;
+static struct semaphore deferred_sema;
+
+static void wheel_insert (struct timeout *);
+static int cascade (int level);
+static void timeout_thread (void *aux);
+
+/* Initializes the timer wheel.  Called by timer_init() before
+   the timer interrupt is enabled. */
+void
+timeout_wheel_init (void)
+{
+  int level, idx;
+
+  for (level = 0; level < WHEEL_LEVELS; level++)
+    for (idx = 0; idx < WHEEL_SIZE; idx++)
+      list_init (&wheel[level][idx]);
+  wheel_time = 0;
+
+  list_init (&deferred_list);
+  sema_init (&deferred_sema, 0);
+}
+
+/* Starts the thread that runs deferred timeouts.  Must be called
+   after thread_start(). */
+void
+timeout_start (void)
+{
+  thread_create ("timeout", PRI_MAX, timeout_thread, NULL);
+}
+
+/* Initializes timeout T to run FUNC with AUX when it expires.
+   If DEFERRED is true, FUNC runs in the timeout thread,
+   otherwise in the timer interrupt handler. */
+void
+timeout_init (struct timeout *t, timeout_func *func, void *aux,
+              bool deferred)
+{
+  ASSERT (t != NULL);
+  ASSERT (func != NULL);
+
+  t->expires = 0;
+  t->func = func;
+  t->aux = aux;
+  t->deferred = deferred;
+  t->pending = false;
+}
+
+/* Arms timeout T to expire TICKS timer ticks from now.  A
+   non-positive TICKS expires on the next tick.  If T is already
+   pending, it is rescheduled. */
+void
+timeout_arm (struct timeout *t, int64_t ticks)
+{
+  enum intr_level old_level;
+
+  ASSERT (t != NULL);
+
+  old_level = intr_disable ();
+  if (t->pending)
+    list_remove (&t->elem);
+  t->expires = timer_ticks () + (ticks > 0 ? ticks : 1);
+  t->pending = true;
+  wheel_insert (t);
+  intr_set_level (old_level);
+}
+
+/* Cancels timeout T.  Returns true if T was pending, in which
+   case its function will not run, or false if T had already
+   started running or was never armed. */
+bool
+timeout_cancel (struct timeout *t)
+{
+  enum intr_level old_level;
+  bool was_pending;
+
+  ASSERT (t != NULL);
+
+  old_level = intr_disable ();
+  was_pending = t->pending;
+  if (was_pending)
+    {
+      list_remove (&t->elem);
+      t->pending = false;
+    }
+  intr_set_level (old_level);
+
+  return was_pending;
+}
+
+/* Returns true if T is armed and its function has not started
+   running yet. */
+bool
+timeout_pending (const struct timeout *t)
+{
+  return t->pending;
+}
+
+/* Advances the timer wheel up to and including tick NOW, running
+   or deferring every timeout that expires on the way.  Called by
+   the timer interrupt handler. */
+void
+timeout_tick (int64_t now)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (wheel_time <= now)
+    {
+      int idx = wheel_time & WHEEL_MASK;
+      struct list *slot = &wheel[0][idx];
+      int level;
+
+      /* Level 0 wrapped around: refill it from the levels above. */
+      if (idx == 0)
+        for (level = 1; level < WHEEL_LEVELS && cascade (level) == 0; level++)
+          continue;
+
+      wheel_time++;
+      while (!list_empty (slot))
+        {
+          struct timeout *t = list_entry (list_pop_front (slot),
+                                          struct timeout, elem);
+          if (t->deferred)
+            {
+              list_push_back (&deferred_list, &t->elem);
+              sema_up (&deferred_sema);
+            }
+          else
+            {
+              t->pending = false;
+              t->func (t->aux);
+            }
+        }
+    }
+}
+
+/* Puts T into the wheel slot for its expiration time.
+   Interrupts must be off. */
+static void
+wheel_insert (struct timeout *t)
+{
+  int64_t slot_time = t->expires;
+  int64_t delta = slot_time - wheel_time;
+  int level;
+
+  if (delta < 0)
+    {
+      /* Already due: run on the next tick processed. */
+      delta = 0;
+      slot_time = wheel_time;
+    }
+  else if (delta > WHEEL_MAX_DELTA)
+    {
+      /* Out of range: park in the farthest slot. */
+      delta = WHEEL_MAX_DELTA;
+      slot_time = wheel_time + delta;
+    }
+
+  for (level = 0; level < WHEEL_LEVELS - 1; level++)
+    if (delta < (1 << (WHEEL_BITS * (level + 1))))
+      break;
+
+  list_push_back (&wheel[level][(slot_time >> (WHEEL_BITS * level))
+                                & WHEEL_MASK],
+                  &t->elem);
+}
+
+/* Moves every timeout in the current slot of LEVEL down to the
+   lower levels and returns the index of that slot.
+   Interrupts must be off. */
+static int
+cascade (int level)
+{
+  int idx = (wheel_time >> (WHEEL_BITS * level)) & WHEEL_MASK;
+  struct list *slot = &wheel[level][idx];
+
+  while (!list_empty (slot))
+    wheel_insert (list_entry (list_pop_front (slot), struct timeout, elem));
+
+  return idx;
+}
+
+/* Thread function that runs expired deferred timeouts with
+   interrupts enabled. */
+static void
+timeout_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      struct timeout *t = NULL;
+      enum intr_level old_level;
+
+      sema_down (&deferred_sema);
+
+      /* The list may be shorter than the semaphore count if a
+         deferred timeout was cancelled before it got to run. */
+      old_level = intr_disable ();
+      if (!list_empty (&deferred_list))
+        {
+          t = list_entry (list_pop_front (&deferred_list),
+                          struct timeout, elem);
+          t->pending = false;
+        }
+      intr_set_level (old_level);
+
+      if (t != NULL)
+        t->func (t->aux);
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef DEVICES_TIMEOUT_H
+#define DEVICES_TIMEOUT_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Kernel timeouts.
+
+   A timeout calls a function once a given number of timer ticks
+   have elapsed.  Pending timeouts are kept in a hierarchical
+   timer wheel that is advanced by the timer interrupt, so arming
+   and cancelling a timeout take constant time no matter how many
+   are pending.
+
+   An immediate timeout runs its function inside the timer
+   interrupt handler, with interrupts off, so the function must
+   not sleep.  A deferred timeout runs its function in the
+   "timeout" kernel thread with interrupts on, where it may sleep
+   or acquire locks.
+
+   timeout_init(), timeout_arm(), timeout_cancel() and
+   timeout_pending() may be called from kernel threads or from
+   interrupt handlers. */
+
+/* Function called when a timeout expires. */
+typedef void timeout_func (void *aux);
+
+/* A timeout. */
+struct timeout
+  {
+    struct list_elem elem;      /* Wheel slot or deferred list element. */
+    int64_t expires;            /* Tick at which to run FUNC. */
+    timeout_func *func;         /* Function to run. */
+    void *aux;                  /* Auxiliary data for FUNC. */
+    bool deferred;              /* Run FUNC in the timeout thread? */
+    bool pending;               /* Armed and FUNC not yet started? */
+  };
+
+void timeout_init (struct timeout *, timeout_func *, void *aux,
+                   bool deferred);
+void timeout_arm (struct timeout *, int64_t ticks);
+bool timeout_cancel (struct timeout *);
+bool timeout_pending (const struct timeout *);
+
+void timeout_wheel_init (void);
+void timeout_start (void);
+void timeout_tick (int64_t now);
+
+#endif /* devices/timeout.h */
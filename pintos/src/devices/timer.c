@@ -1,9 +1,12 @@
 #include "devices/timer.h"
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stdio.h>
 #include "devices/pit.h"
+#include "devices/timeout.h"
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
@@ -24,7 +27,15 @@ static int64_t ticks;
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* List of threads blocked in timer_sleep(), ordered by
+   ascending wakeup_time.  Threads with equal wakeup_time are
+   kept in the order in which they went to sleep. */
+static struct list sleeping_list;
+
 static intr_handler_func timer_interrupt;
+static bool wakeup_less (const struct list_elem *, const struct list_elem *,
+                         void *aux);
+static void wakeup_threads (void);
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
@@ -36,6 +47,8 @@ void
 timer_init (void)
 {
   pit_configure_channel (0, 2, TIMER_FREQ);
+  list_init (&sleeping_list);
+  timeout_wheel_init ();
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
 
@@ -85,15 +98,30 @@ timer_elapsed (int64_t then)
 }
 
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
-   be turned on. */
+   be turned on.
+
+   The calling thread is blocked on sleeping_list and is not
+   scheduled again until timer_interrupt() finds that its wakeup
+   time has passed, so a sleeping thread costs nothing while it
+   sleeps.  Non-positive TICKS return immediately. */
 void
 timer_sleep (int64_t ticks)
 {
-  int64_t start = timer_ticks ();
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
 
   ASSERT (intr_get_level () == INTR_ON);
-  while (timer_elapsed (start) < ticks)
-    thread_yield ();
+  if (ticks <= 0)
+    return;
+
+  /* Interrupts stay off from inserting into sleeping_list until
+     we are blocked, or the timer interrupt could try to unblock
+     a thread that is still running. */
+  old_level = intr_disable ();
+  cur->wakeup_time = timer_ticks () + ticks;
+  list_insert_ordered (&sleeping_list, &cur->elem, wakeup_less, NULL);
+  thread_block ();
+  intr_set_level (old_level);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -171,7 +199,38 @@ static void
 timer_interrupt (struct intr_frame *args UNUSED)
 {
   ticks++;
+  wakeup_threads ();
+  timeout_tick (ticks);
   thread_tick ();
+  cpu_tick_others ();
+}
+
+/* Returns true if the thread owning A should wake up strictly
+   before the thread owning B. */
+static bool
+wakeup_less (const struct list_elem *a, const struct list_elem *b,
+             void *aux UNUSED)
+{
+  return list_entry (a, struct thread, elem)->wakeup_time
+         < list_entry (b, struct thread, elem)->wakeup_time;
+}
+
+/* Unblocks every sleeping thread whose wakeup time has been
+   reached.  Since sleeping_list is sorted, this only touches the
+   threads that actually wake up, plus one.  Runs in the timer
+   interrupt handler. */
+static void
+wakeup_threads (void)
+{
+  while (!list_empty (&sleeping_list))
+    {
+      struct thread *t = list_entry (list_front (&sleeping_list),
+                                     struct thread, elem);
+      if (t->wakeup_time > ticks)
+        break;
+      list_pop_front (&sleeping_list);
+      thread_unblock (t);
+    }
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
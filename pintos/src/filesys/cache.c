@@ -1,130 +1,1651 @@
 #include "filesys/cache.h"
 #include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <round.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include "devices/timer.h"
+#include "filesys/free-map.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/spinlock.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 
 struct lock cache_lock;
 
-#define CACHE_SIZE 64
+/* The cache is made of whole pages from the kernel pool, so its
+   size in sectors is always a multiple of SECTORS_PER_PAGE.  Each
+   entry caches a block of 1 << BLOCK_SHIFT consecutive sectors
+   that starts at a multiple of that many sectors on the device,
+   with a bitmap of the sectors read in and another of those that
+   are dirty, so a page holds SECTORS_PER_PAGE >> BLOCK_SHIFT
+   entries.  Blocks of more than one sector let a large read find
+   several sectors in one entry and load them with one multi-sector
+   device request. */
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+#define CACHE_DEFAULT_SIZE 64           /* Default size in sectors. */
+#define CACHE_MAX_SIZE 8192             /* Largest size allowed, in sectors. */
+static unsigned block_shift;            /* Log2 of sectors per block. */
+
+/* A cache with room to grow adds a page when the kernel pool has
+   more than CACHE_GROW_FREE free pages, and gives one back when it
+   has fewer than CACHE_SHRINK_FREE. */
+#define CACHE_GROW_FREE 128
+#define CACHE_SHRINK_FREE 32
+
+/* Write-behind.  Every FLUSH_INTERVAL ticks the flusher thread
+   writes back, in ascending sector order, the entries that have
+   been dirty for FLUSH_EXPIRE_INTERVALS intervals.  Entries written
+   to more recently are left alone so that repeated writes to them
+   are coalesced.  If FLUSH_RATIO is nonzero and more than that
+   percentage of entries are dirty, the flusher is woken early and
+   writes back every dirty entry. */
+#define FLUSH_EXPIRE_INTERVALS 6
+static int64_t flush_interval = 5 * TIMER_FREQ;
+static unsigned flush_ratio;
+
+/* Every statistic below except the flusher's is updated and
+   zeroed with STATS_LOCK held, so that cache_reset() zeroes them
+   all at once and readers see a consistent set.  Updates are
+   short and cannot sleep. */
+static struct spinlock stats_lock = SPINLOCK_INITIALIZER;
 
 int total_cnt;
 int hit_cnt;
 
+/* Read-ahead.  cache_prefetch() queues sectors, and the readahead
+   thread loads them.  An access that finds a prefetched entry not
+   yet touched since it was loaded counts as a prefetch hit rather
+   than an ordinary hit; a prefetched entry evicted before it is
+   touched counts as wasted. */
+#define PREFETCH_QUEUE_SIZE 64
+struct prefetch_req
+  {
+    struct block *block;
+    block_sector_t sector;
+  };
+static struct prefetch_req prefetch_queue[PREFETCH_QUEUE_SIZE];
+static size_t prefetch_head;            /* Index of oldest request. */
+static size_t prefetch_len;             /* # of queued requests. */
+static struct lock prefetch_lock;       /* Protects the queue. */
+static struct semaphore prefetch_avail; /* Counts queued requests. */
+static unsigned prefetch_cnt;           /* # of sectors prefetched. */
+static unsigned prefetch_hit_cnt;       /* # of accesses they served. */
+static unsigned prefetch_waste_cnt;     /* # evicted untouched. */
+
+/* Number of sectors cached for a full-sector write without being
+   read first. */
+static unsigned overwrite_cnt;
+
+/* Per-class statistics, except for SECTORS and DIRTY, which are
+   computed when asked for. */
+static struct cache_class_stats class_stats[CACHE_CLASS_CNT];
+
+/* Number of valid entries of each class, protected by cache_lock.
+   Metadata entries are protected from eviction by data while they
+   make up no more than META_RESERVE percent of the cache. */
+static size_t class_cnt[CACHE_CLASS_CNT];
+static unsigned meta_reserve = 25;
+
+/* Largest META_RESERVE allowed.  Delayed blocks may pin another
+   quarter of the cache, and this leaves at least a quarter that a
+   data miss can always evict. */
+#define META_RESERVE_MAX 50
+
+/* The first CACHE_TRACE_SIZE demand accesses since the last
+   cache_reset(), for cache_replay(). */
+#define CACHE_TRACE_SIZE 8192
+struct cache_access
+  {
+    block_sector_t sector;
+    enum cache_class class;
+  };
+static struct cache_access *cache_trace;
+static size_t trace_cnt;
+static bool trace_paused;               /* Don't record, replaying. */
+
+/* Replacement list a cache entry or a ghost is on. */
+enum cache_queue
+  {
+    QUEUE_NONE,                         /* None. */
+    QUEUE_FREE,                         /* free_entries. */
+    QUEUE_RECENT,                       /* Recent queue or ghosts. */
+    QUEUE_FREQUENT                      /* Frequent queue or ghosts. */
+  };
+
 struct cache_t
   {
-    block_sector_t sector;              /* The sector index of the cached block. */
+    block_sector_t sector;              /* First sector of the cached block. */
+    struct list_elem hash_elem;         /* Element in cache_index bucket. */
     struct lock block_lock;             /* Lock on the current block of data. */
-    char data[BLOCK_SECTOR_SIZE];       /* Cached data. */
+    char *data;                         /* Cached data, in a palloc page. */
     bool valid;                         /* Valid bit. */
-    bool dirty;                         /* Dirty bit. */
+    uint8_t valid_map;                  /* Sectors of the block read in. */
+    uint8_t dirty_map;                  /* Sectors of the block dirty. */
     bool used;                          /* Used bit for clock algorithm. */
+    bool io;                            /* Disk transfer in progress. */
+    uint8_t writeback_map;              /* Sectors of OLD_SECTOR's block
+                                           being written back. */
+    block_sector_t old_sector;          /* Block being written back. */
+    struct list_elem writeback_elem;    /* Element in writeback_list,
+                                           while WRITEBACK_MAP is set. */
+    int64_t dirtied_at;                 /* Tick at which it became dirty. */
+    bool prefetched;                    /* Loaded by read-ahead, untouched. */
+    enum cache_class class;             /* What it holds, if valid. */
+    enum cache_queue queue;             /* Replacement list it is on. */
+    struct list_elem queue_elem;        /* Element in that list. */
   };
 
-struct cache_t cache[CACHE_SIZE];
+/* Cache entries.  There are CACHE_MAX of them, but only the first
+   CACHE_CNT have data pages and take part in replacement.  The
+   sizes given in sectors are turned into entries by cache_init(). */
+static struct cache_t *cache;
+static size_t cache_cnt;                /* Current size in entries. */
+static size_t cache_min;                /* Never shrink below. */
+static size_t cache_max;                /* Never grow above. */
+static size_t min_sectors = CACHE_DEFAULT_SIZE; /* CACHE_MIN in sectors. */
+static size_t max_sectors;              /* CACHE_MAX in sectors. */
+static bool cache_resizing;             /* A resize is in progress. */
+static unsigned grow_cnt;               /* # of pages added at runtime. */
+static unsigned shrink_cnt;             /* # of pages given back. */
+static size_t dirty_cnt;                /* # of dirty entries. */
 
-int clock_hand;
+/* Flusher thread state. */
+static struct semaphore flush_wakeup;   /* Wakes the flusher early. */
+static bool flush_all;                  /* Early wakeup is pending. */
+static block_sector_t *flush_sectors;   /* Blocks to flush in a pass. */
+static char flush_buf[PGSIZE];          /* Copy of a block being flushed. */
+static unsigned flush_pass_cnt;         /* # of flusher passes. */
+static unsigned flush_write_cnt;        /* # of sectors it wrote. */
 
-struct cache_t *cache_get (struct block *, block_sector_t);
+/* Copy of a delayed block being moved by cache_move(). */
+static char move_buf[BLOCK_SECTOR_SIZE];
+static struct lock move_lock;           /* Protects MOVE_BUF. */
+
+/* Index of the valid entries of CACHE by first sector, so that a
+   lookup does not have to scan every entry.  An entry is in
+   bucket cache_bucket(SECTOR) exactly when it is valid and holds
+   the block that starts at SECTOR.  Protected by cache_lock. */
+static struct list *cache_index;
+static size_t cache_bucket_cnt;         /* Power of 2. */
+
+/* Entries still writing back the block they held before they were
+   given to another one, so that a block can be checked for a
+   pending write-back without scanning every entry.  There are only
+   as many as there are evictions in progress.  Protected by
+   cache_lock. */
+static struct list writeback_list;
+
+size_t clock_hand;
+
+/* Signaled, with cache_lock held, whenever an entry's disk
+   transfer finishes. */
+static struct condition io_done;
+
+/* How to get a sector into the cache. */
+enum cache_get_flags
+  {
+    GET_PREFETCH = 001,         /* Loaded for read-ahead. */
+    GET_OVERWRITE = 002         /* Caller overwrites all of it. */
+  };
+
+struct cache_t *cache_get (struct block *, block_sector_t, size_t cnt,
+                           enum cache_class, enum cache_get_flags,
+                           bool *hit);
 void cache_done (struct cache_t *);
+static void flusher (void *aux);
+static void readahead (void *aux);
+
+/* Returns the cache_index bucket for SECTOR. */
+static struct list *
+cache_bucket (block_sector_t sector)
+{
+  return &cache_index[hash_int (sector) & (cache_bucket_cnt - 1)];
+}
+
+/* Returns the valid cache entry holding the block that starts at
+   SECTOR, or a null pointer if it is not cached.  The caller must
+   hold cache_lock. */
+static struct cache_t *
+cache_lookup (block_sector_t sector)
+{
+  struct list *bucket = cache_bucket (sector);
+  struct list_elem *e;
+
+  for (e = list_begin (bucket); e != list_end (bucket); e = list_next (e))
+    {
+      struct cache_t *c = list_entry (e, struct cache_t, hash_elem);
+      if (c->sector == sector)
+        return c;
+    }
+  return NULL;
+}
+
+/* Returns the number of sectors in bitmap MAP. */
+static unsigned
+map_cnt (unsigned map)
+{
+  unsigned cnt = 0;
+
+  for (; map != 0; map &= map - 1)
+    cnt++;
+  return cnt;
+}
+
+/* Returns the bitmap of the sectors of the block starting at BASE
+   that exist on BLOCK: all of them, unless the block runs past the
+   end of the device, and none for a delayed block. */
+static unsigned
+cache_block_map (struct block *block, block_sector_t base)
+{
+  block_sector_t size = block_size (block);
+  size_t cnt = cache_block_sectors ();
+
+  if (base >= size)
+    return 0;
+  if (base + cnt > size)
+    cnt = size - base;
+  return (1u << cnt) - 1;
+}
+
+/* Reads into DATA from BLOCK, or writes DATA to BLOCK if WRITE is
+   true, the sectors in MAP of the cache block that starts at BASE,
+   one device request per run of consecutive sectors.  Returns the
+   number of sectors transferred. */
+static size_t
+cache_transfer (struct block *block, block_sector_t base, char *data,
+                unsigned map, bool write)
+{
+  size_t total = 0;
+  size_t i = 0;
+
+  while (map >> i != 0)
+    {
+      size_t n = 0;
+
+      if (!(map & (1u << i)))
+        {
+          i++;
+          continue;
+        }
+      while (map & (1u << (i + n)))
+        n++;
+      if (write)
+        block_write_multi (block, base + i, n, data + i * BLOCK_SECTOR_SIZE);
+      else
+        block_read_multi (block, base + i, n, data + i * BLOCK_SECTOR_SIZE);
+      total += n;
+      i += n;
+    }
+  return total;
+}
+
+/* Marks the sectors in MAP of cache entry C, whose block lock the
+   caller holds, as dirty.  Wakes the flusher if too much of the
+   cache is dirty.  Never blocks. */
+static void
+cache_mark_dirty (struct cache_t *c, unsigned map)
+{
+  bool was_dirty = c->dirty_map != 0;
+
+  c->dirty_map |= map;
+  if (was_dirty)
+    return;
+
+  c->dirtied_at = timer_ticks ();
+  dirty_cnt++;
+  if (flush_ratio != 0 && !flush_all
+      && dirty_cnt * 100 > flush_ratio * cache_cnt)
+    {
+      flush_all = true;
+      sema_up (&flush_wakeup);
+    }
+}
+
+/* Marks cache entry C, whose block lock the caller holds, as
+   clean. */
+static void
+cache_clean (struct cache_t *c)
+{
+  if (c->dirty_map)
+    {
+      c->dirty_map = 0;
+      dirty_cnt--;
+    }
+}
+
+/* Notes that entry C is about to write back the sectors in MAP of
+   the block starting at OLD_SECTOR, which it held until now.  The
+   caller must hold cache_lock. */
+static void
+cache_writeback_begin (struct cache_t *c, block_sector_t old_sector,
+                       unsigned map)
+{
+  c->writeback_map = map;
+  c->old_sector = old_sector;
+  if (map != 0)
+    list_push_back (&writeback_list, &c->writeback_elem);
+}
+
+/* Notes that entry C finished the write-back begun by
+   cache_writeback_begin().  The caller must hold cache_lock. */
+static void
+cache_writeback_end (struct cache_t *c)
+{
+  if (c->writeback_map != 0)
+    list_remove (&c->writeback_elem);
+  c->writeback_map = 0;
+}
+
+/* Returns true if metadata entries now make up no more than
+   their reserved share of the cache. */
+static bool
+cache_meta_protected (void)
+{
+  size_t meta = class_cnt[CACHE_INODE] + class_cnt[CACHE_INDEX]
+                + class_cnt[CACHE_DIR];
+
+  return meta * 100 <= cache_cnt * meta_reserve;
+}
+
+/* Returns true if C may be evicted to make room for a sector of
+   class CLASS: it must not be in the middle of a transfer or hold
+   a delayed block, and data may not evict metadata within its
+   reserved share.  The caller must hold cache_lock. */
+static bool
+cache_evictable (const struct cache_t *c, enum cache_class class)
+{
+  if (c->io || (c->valid && cache_delayed (c->sector)))
+    return false;
+  if (class == CACHE_DATA && c->valid && c->class != CACHE_DATA)
+    return !cache_meta_protected ();
+  return true;
+}
+
+/* Replacement policies.
+
+   A policy decides which valid entry to evict when the cache is
+   full.  Invalid entries that are not in the middle of a transfer
+   wait on FREE_ENTRIES and are always used first, so a policy only
+   ever sees valid entries.  Every hook is called with cache_lock
+   held:
+
+     - touch: C was found in the cache by a demand access.
+     - load: C has just been given C->SECTOR after a miss.
+     - drop: C is being invalidated without eviction.
+     - evict: choose and detach a victim to hold SECTOR of class
+       CLASS among the entries cache_evictable() allows, or return
+       a null pointer if there is none.
+
+   Besides the clock algorithm, the policies keep resident entries
+   on two queues, RECENT and FREQUENT, most recently used at the
+   front, and remember some recently evicted sectors on two ghost
+   lists of the same names.  Ghosts are indexed by sector in the
+   same way as the cache itself. */
+struct cache_policy
+  {
+    const char *name;
+    void (*init) (void);
+    void (*touch) (struct cache_t *);
+    void (*load) (struct cache_t *);
+    void (*drop) (struct cache_t *);
+    struct cache_t *(*evict) (block_sector_t sector,
+                              enum cache_class class);
+  };
+
+static struct list free_entries;        /* Invalid entries, not in I/O. */
+static struct list recent_queue;        /* Resident, seen once. */
+static struct list frequent_queue;      /* Resident, seen again. */
+static size_t recent_cnt;
+static size_t frequent_cnt;
+
+/* A sector that was evicted recently. */
+struct ghost
+  {
+    block_sector_t sector;              /* The evicted sector. */
+    enum cache_queue queue;             /* Ghost list it is on. */
+    struct list_elem elem;              /* Element in ghost list. */
+    struct list_elem hash_elem;         /* Element in ghost_index. */
+  };
+
+static struct ghost *ghosts;            /* CACHE_MAX ghosts. */
+static struct list free_ghosts;
+static struct list recent_ghosts;
+static struct list frequent_ghosts;
+static size_t recent_ghost_cnt;
+static size_t frequent_ghost_cnt;
+static struct list *ghost_index;        /* CACHE_BUCKET_CNT buckets. */
+
+/* Puts C at the front of Q, which must be QUEUE_RECENT or
+   QUEUE_FREQUENT. */
+static void
+queue_push (struct cache_t *c, enum cache_queue q)
+{
+  ASSERT (c->queue == QUEUE_NONE);
+  if (q == QUEUE_RECENT)
+    {
+      list_push_front (&recent_queue, &c->queue_elem);
+      recent_cnt++;
+    }
+  else
+    {
+      list_push_front (&frequent_queue, &c->queue_elem);
+      frequent_cnt++;
+    }
+  c->queue = q;
+}
+
+/* Takes C off the queue it is on, if any. */
+static void
+queue_remove (struct cache_t *c)
+{
+  if (c->queue == QUEUE_RECENT)
+    recent_cnt--;
+  else if (c->queue == QUEUE_FREQUENT)
+    frequent_cnt--;
+  if (c->queue != QUEUE_NONE)
+    list_remove (&c->queue_elem);
+  c->queue = QUEUE_NONE;
+}
+
+/* Returns the least recently used entry of Q that may be evicted
+   for a sector of class CLASS, or a null pointer if there is
+   none. */
+static struct cache_t *
+queue_victim (enum cache_queue q, enum cache_class class)
+{
+  struct list *list = q == QUEUE_RECENT ? &recent_queue : &frequent_queue;
+  struct list_elem *e;
+
+  for (e = list_rbegin (list); e != list_rend (list); e = list_prev (e))
+    {
+      struct cache_t *c = list_entry (e, struct cache_t, queue_elem);
+      if (cache_evictable (c, class))
+        return c;
+    }
+  return NULL;
+}
+
+/* Returns the ghost_index bucket for SECTOR. */
+static struct list *
+ghost_bucket (block_sector_t sector)
+{
+  return &ghost_index[hash_int (sector) & (cache_bucket_cnt - 1)];
+}
+
+/* Returns the ghost of SECTOR, or a null pointer if it has none. */
+static struct ghost *
+ghost_find (block_sector_t sector)
+{
+  struct list *bucket = ghost_bucket (sector);
+  struct list_elem *e;
+
+  for (e = list_begin (bucket); e != list_end (bucket); e = list_next (e))
+    {
+      struct ghost *g = list_entry (e, struct ghost, hash_elem);
+      if (g->sector == sector)
+        return g;
+    }
+  return NULL;
+}
+
+/* Forgets ghost G. */
+static void
+ghost_remove (struct ghost *g)
+{
+  if (g->queue == QUEUE_RECENT)
+    recent_ghost_cnt--;
+  else
+    frequent_ghost_cnt--;
+  list_remove (&g->elem);
+  list_remove (&g->hash_elem);
+  list_push_front (&free_ghosts, &g->elem);
+}
+
+/* Forgets the oldest ghost on ghost list Q, if it has any. */
+static void
+ghost_trim (enum cache_queue q)
+{
+  struct list *list = q == QUEUE_RECENT ? &recent_ghosts : &frequent_ghosts;
+
+  if (!list_empty (list))
+    ghost_remove (list_entry (list_back (list), struct ghost, elem));
+}
+
+/* Remembers SECTOR at the front of ghost list Q, forgetting the
+   oldest ghost on Q if there is no room. */
+static void
+ghost_add (block_sector_t sector, enum cache_queue q)
+{
+  struct ghost *g;
+
+  if (list_empty (&free_ghosts))
+    ghost_trim (q);
+  if (list_empty (&free_ghosts))
+    ghost_trim (q == QUEUE_RECENT ? QUEUE_FREQUENT : QUEUE_RECENT);
+
+  g = list_entry (list_pop_front (&free_ghosts), struct ghost, elem);
+  g->sector = sector;
+  g->queue = q;
+  if (q == QUEUE_RECENT)
+    {
+      list_push_front (&recent_ghosts, &g->elem);
+      recent_ghost_cnt++;
+    }
+  else
+    {
+      list_push_front (&frequent_ghosts, &g->elem);
+      frequent_ghost_cnt++;
+    }
+  list_push_front (ghost_bucket (sector), &g->hash_elem);
+}
+
+/* Forgets every ghost and empties both queues. */
+static void
+queues_init (void)
+{
+  size_t i;
+
+  list_init (&recent_queue);
+  list_init (&frequent_queue);
+  recent_cnt = frequent_cnt = 0;
+
+  list_init (&free_ghosts);
+  list_init (&recent_ghosts);
+  list_init (&frequent_ghosts);
+  recent_ghost_cnt = frequent_ghost_cnt = 0;
+  for (i = 0; i < cache_bucket_cnt; i++)
+    list_init (&ghost_index[i]);
+  for (i = 0; i < cache_max; i++)
+    list_push_back (&free_ghosts, &ghosts[i].elem);
+}
+
+/* Clock: approximates LRU with one USED bit per entry, set on
+   every access and cleared as the clock hand sweeps past. */
+static void
+clock_init (void)
+{
+  clock_hand = 0;
+}
+
+static void
+clock_touch (struct cache_t *c)
+{
+  c->used = true;
+}
+
+static void
+clock_load (struct cache_t *c UNUSED)
+{
+}
+
+static void
+clock_drop (struct cache_t *c UNUSED)
+{
+}
+
+static struct cache_t *
+clock_evict (block_sector_t sector UNUSED, enum cache_class class)
+{
+  size_t i;
+  for (i = 0; i < 2 * cache_cnt; ++i)
+    {
+      struct cache_t *c = &cache[clock_hand];
+      if (cache_evictable (c, class))
+        {
+          if (!c->valid || !c->used)
+            return c;
+          c->used = false;
+        }
+      clock_hand = (clock_hand + 1) % cache_cnt;
+    }
+  return NULL;
+}
+
+/* Exact LRU, on the RECENT queue alone. */
+static void
+lru_touch (struct cache_t *c)
+{
+  queue_remove (c);
+  queue_push (c, QUEUE_RECENT);
+}
+
+static void
+lru_load (struct cache_t *c)
+{
+  queue_push (c, QUEUE_RECENT);
+}
+
+static struct cache_t *
+lru_evict (block_sector_t sector UNUSED, enum cache_class class)
+{
+  struct cache_t *c = queue_victim (QUEUE_RECENT, class);
+  if (c != NULL)
+    queue_remove (c);
+  return c;
+}
+
+/* 2Q, after Johnson and Shasha.  New sectors enter the RECENT
+   queue (A1in), a FIFO holding about a quarter of the cache, and
+   leave a ghost (A1out) behind when evicted.  A sector missed
+   again while it still has a ghost was reused within a short
+   time, so it goes on the FREQUENT queue (Am), an LRU list.  A
+   single sequential scan thus only churns A1in. */
+#define TWOQ_RECENT_PCT 25
+#define TWOQ_GHOST_PCT 50
+
+static void
+twoq_touch (struct cache_t *c)
+{
+  if (c->queue == QUEUE_FREQUENT)
+    {
+      queue_remove (c);
+      queue_push (c, QUEUE_FREQUENT);
+    }
+}
+
+static void
+twoq_load (struct cache_t *c)
+{
+  struct ghost *g = ghost_find (c->sector);
+
+  if (g != NULL)
+    {
+      ghost_remove (g);
+      queue_push (c, QUEUE_FREQUENT);
+    }
+  else
+    queue_push (c, QUEUE_RECENT);
+}
+
+static struct cache_t *
+twoq_evict (block_sector_t sector UNUSED, enum cache_class class)
+{
+  struct cache_t *c = NULL;
+
+  if (recent_cnt * 100 > cache_cnt * TWOQ_RECENT_PCT
+      || frequent_cnt == 0)
+    {
+      c = queue_victim (QUEUE_RECENT, class);
+      if (c != NULL)
+        {
+          while (recent_ghost_cnt * 100 >= cache_cnt * TWOQ_GHOST_PCT)
+            ghost_trim (QUEUE_RECENT);
+          ghost_add (c->sector, QUEUE_RECENT);
+        }
+    }
+  if (c == NULL)
+    c = queue_victim (QUEUE_FREQUENT, class);
+  if (c == NULL)
+    c = queue_victim (QUEUE_RECENT, class);
+  if (c != NULL)
+    queue_remove (c);
+  return c;
+}
+
+/* ARC, after Megiddo and Modha.  RECENT (T1) holds sectors seen
+   once and FREQUENT (T2) sectors seen at least twice, each with a
+   ghost list (B1, B2) of about as many evicted sectors.  A miss on
+   a B1 ghost means T1 was too small, and one on a B2 ghost that T2
+   was, so ARC_TARGET, the size T1 aims for, moves towards the list
+   whose ghosts are being hit. */
+static size_t arc_target;
+
+/* Returns ARC_TARGET adapted for a miss on SECTOR. */
+static size_t
+arc_adapt (block_sector_t sector)
+{
+  struct ghost *g = ghost_find (sector);
+  size_t delta;
+
+  if (g == NULL)
+    return arc_target;
+  else if (g->queue == QUEUE_RECENT)
+    {
+      delta = frequent_ghost_cnt > recent_ghost_cnt
+              ? frequent_ghost_cnt / recent_ghost_cnt : 1;
+      return arc_target + delta < cache_cnt ? arc_target + delta : cache_cnt;
+    }
+  else
+    {
+      delta = recent_ghost_cnt > frequent_ghost_cnt
+              ? recent_ghost_cnt / frequent_ghost_cnt : 1;
+      return arc_target > delta ? arc_target - delta : 0;
+    }
+}
+
+static void
+arc_init (void)
+{
+  queues_init ();
+  arc_target = 0;
+}
+
+static void
+arc_touch (struct cache_t *c)
+{
+  queue_remove (c);
+  queue_push (c, QUEUE_FREQUENT);
+}
+
+static void
+arc_load (struct cache_t *c)
+{
+  struct ghost *g;
+
+  arc_target = arc_adapt (c->sector);
+  g = ghost_find (c->sector);
+  if (g != NULL)
+    {
+      ghost_remove (g);
+      queue_push (c, QUEUE_FREQUENT);
+      return;
+    }
+
+  /* Keep T1 + B1 within the cache size and everything within
+     twice that. */
+  if (recent_cnt + recent_ghost_cnt >= cache_cnt)
+    ghost_trim (QUEUE_RECENT);
+  else if (recent_cnt + frequent_cnt + recent_ghost_cnt
+           + frequent_ghost_cnt >= 2 * cache_cnt)
+    ghost_trim (QUEUE_FREQUENT);
+  queue_push (c, QUEUE_RECENT);
+}
+
+static struct cache_t *
+arc_evict (block_sector_t sector, enum cache_class class)
+{
+  struct ghost *g = ghost_find (sector);
+  size_t target = arc_adapt (sector);
+  struct cache_t *c = NULL;
 
+  if (recent_cnt > 0
+      && (recent_cnt > target
+          || (g != NULL && g->queue == QUEUE_FREQUENT
+              && recent_cnt == target)))
+    c = queue_victim (QUEUE_RECENT, class);
+  if (c == NULL)
+    c = queue_victim (QUEUE_FREQUENT, class);
+  if (c == NULL)
+    c = queue_victim (QUEUE_RECENT, class);
+  if (c != NULL)
+    {
+      enum cache_queue q = c->queue;
+      queue_remove (c);
+      ghost_add (c->sector, q);
+    }
+  return c;
+}
+
+static const struct cache_policy cache_policies[] =
+  {
+    {"clock", clock_init, clock_touch, clock_load, clock_drop, clock_evict},
+    {"lru", queues_init, lru_touch, lru_load, queue_remove, lru_evict},
+    {"2q", queues_init, twoq_touch, twoq_load, queue_remove, twoq_evict},
+    {"arc", arc_init, arc_touch, arc_load, queue_remove, arc_evict},
+  };
+#define CACHE_POLICY_CNT (sizeof cache_policies / sizeof *cache_policies)
+
+/* The policy in use. */
+static const struct cache_policy *policy = &cache_policies[0];
+
+/* Returns the policy named NAME, or a null pointer if there is
+   none. */
+static const struct cache_policy *
+cache_find_policy (const char *name)
+{
+  size_t i;
+
+  for (i = 0; i < CACHE_POLICY_CNT; i++)
+    if (!strcmp (cache_policies[i].name, name))
+      return &cache_policies[i];
+  return NULL;
+}
+
+/* Uses the replacement policy named NAME, one of "clock" (the
+   default), "lru", "2q", or "arc".  Returns false if there is no
+   such policy.  Must be called before cache_init(). */
+bool
+cache_set_policy (const char *name)
+{
+  const struct cache_policy *p = cache_find_policy (name);
+
+  if (p == NULL)
+    return false;
+  policy = p;
+  return true;
+}
+
+/* Puts C, which is invalid and not in I/O, on FREE_ENTRIES. */
+static void
+cache_free (struct cache_t *c)
+{
+  ASSERT (c->queue == QUEUE_NONE);
+  list_push_back (&free_entries, &c->queue_elem);
+  c->queue = QUEUE_FREE;
+}
+
+/* Returns an entry to hold SECTOR of class CLASS: an invalid one
+   if there is any, otherwise the victim chosen by the replacement
+   policy.  Returns a null pointer if no entry may be evicted.  The
+   caller must hold cache_lock. */
+static struct cache_t *
+cache_victim (block_sector_t sector, enum cache_class class)
+{
+  if (!list_empty (&free_entries))
+    {
+      struct cache_t *c = list_entry (list_front (&free_entries),
+                                      struct cache_t, queue_elem);
+      queue_remove (c);
+      return c;
+    }
+  return policy->evict (sector, class);
+}
+
+/* Adds the write-back of CNT dirty sectors of class CLASS to the
+   statistics. */
+static void
+cache_count_writeback (enum cache_class class, size_t cnt)
+{
+  enum intr_level old_level = spin_lock_irqsave (&stats_lock);
+  class_stats[class].writebacks += cnt;
+  spin_unlock_irqrestore (&stats_lock, old_level);
+}
+
+/* Returns the percentage of accesses since the last cache_reset()
+   that hit, or 0 if there were none. */
 int
 get_hit_rate (void)
 {
-  return (hit_cnt * 100) / total_cnt;
+  enum intr_level old_level = spin_lock_irqsave (&stats_lock);
+  int rate = total_cnt > 0 ? hit_cnt * 100 / total_cnt : 0;
+  spin_unlock_irqrestore (&stats_lock, old_level);
+
+  return rate;
+}
+
+/* Stores in *STATS the statistics for CLASS. */
+void
+get_class_stats (enum cache_class class, struct cache_class_stats *stats)
+{
+  enum intr_level old_level;
+  size_t i;
+
+  ASSERT (class < CACHE_CLASS_CNT);
+
+  lock_acquire (&cache_lock);
+  old_level = spin_lock_irqsave (&stats_lock);
+  *stats = class_stats[class];
+  spin_unlock_irqrestore (&stats_lock, old_level);
+
+  stats->sectors = 0;
+  stats->dirty = 0;
+  for (i = 0; i < cache_cnt; i++)
+    if (cache[i].valid && cache[i].class == class)
+      {
+        stats->sectors += map_cnt (cache[i].valid_map);
+        stats->dirty += map_cnt (cache[i].dirty_map);
+      }
+  lock_release (&cache_lock);
+}
+
+/* Invalidates every entry of the cache, without writing dirty
+   ones back, and switches to replacement policy P.  Delayed
+   blocks, whose data is nowhere else, are kept, and handed over
+   to P.  The caller must hold cache_lock. */
+static void
+cache_invalidate (const struct cache_policy *p)
+{
+  size_t i;
+
+  /* Wait until no entry is in the middle of a transfer, then
+     invalidate them all without letting go of cache_lock, so that
+     none can be reloaded meanwhile. */
+  for (i = 0; i < cache_cnt; )
+    if (cache[i].io)
+      {
+        cond_wait (&io_done, &cache_lock);
+        i = 0;
+      }
+    else
+      i++;
+
+  for (i = 0; i < cache_cnt; ++i)
+    if (cache[i].valid)
+      {
+        struct cache_t *c = &cache[i];
+
+        lock_acquire (&c->block_lock);
+        policy->drop (c);
+        if (cache_delayed (c->sector))
+          {
+            lock_release (&c->block_lock);
+            continue;
+          }
+        list_remove (&c->hash_elem);
+        class_cnt[c->class]--;
+        c->valid = false;
+        c->valid_map = 0;
+        c->prefetched = false;
+        cache_clean (c);
+        cache_free (c);
+        lock_release (&c->block_lock);
+      }
+
+  policy = p;
+  policy->init ();
+  for (i = 0; i < cache_cnt; ++i)
+    if (cache[i].valid)
+      policy->load (&cache[i]);
 }
 
+/* Writes every dirty entry back, empties the cache, and zeroes
+   the statistics.  Delayed blocks are allocated and changes to
+   the free map are written into the cache first, so that they are
+   written back too.  Blocks delayed after that stay cached. */
 void
 cache_reset (void)
 {
+  enum intr_level old_level;
+
+  inode_flush_delayed ();
+  free_map_flush ();
   cache_close (get_fs_device ());
   lock_acquire (&cache_lock);
+  cache_invalidate (policy);
+
+  old_level = spin_lock_irqsave (&stats_lock);
   total_cnt = 0;
   hit_cnt = 0;
-  int i;
-  for (i = 0; i < CACHE_SIZE; ++i)
+  prefetch_cnt = 0;
+  prefetch_hit_cnt = 0;
+  prefetch_waste_cnt = 0;
+  overwrite_cnt = 0;
+  trace_cnt = 0;
+  memset (class_stats, 0, sizeof class_stats);
+  spin_unlock_irqrestore (&stats_lock, old_level);
+  lock_release (&cache_lock);
+}
+
+/* Sets the initial size of the cache to SECTORS, rounded up to a
+   whole page.  The cache never shrinks below this size.  Must be
+   called before cache_init(). */
+void
+cache_set_size (size_t sectors)
+{
+  min_sectors = ROUND_UP (sectors, SECTORS_PER_PAGE);
+  if (min_sectors < SECTORS_PER_PAGE)
+    min_sectors = SECTORS_PER_PAGE;
+  if (min_sectors > CACHE_MAX_SIZE)
+    min_sectors = CACHE_MAX_SIZE;
+}
+
+/* Lets the cache grow up to SECTORS, rounded up to a whole page,
+   while free memory allows.  Must be called before cache_init(). */
+void
+cache_set_max_size (size_t sectors)
+{
+  max_sectors = ROUND_UP (sectors, SECTORS_PER_PAGE);
+  if (max_sectors > CACHE_MAX_SIZE)
+    max_sectors = CACHE_MAX_SIZE;
+}
+
+/* Makes each cache entry hold a block of SECTORS consecutive
+   sectors, which must be a power of 2 no greater than a page.
+   Returns false if SECTORS is not allowed.  Must be called before
+   cache_init(). */
+bool
+cache_set_block_size (size_t sectors)
+{
+  unsigned shift;
+
+  for (shift = 0; (1u << shift) < sectors; shift++)
+    continue;
+  if (sectors == 0 || (1u << shift) != sectors
+      || sectors > SECTORS_PER_PAGE)
+    return false;
+  block_shift = shift;
+  return true;
+}
+
+/* Returns the number of sectors in a cache block.  Sectors N and M
+   are in the same block if N / cache_block_sectors() equals M /
+   cache_block_sectors(). */
+size_t
+cache_block_sectors (void)
+{
+  return (size_t) 1 << block_shift;
+}
+
+/* Sets the write-behind interval to MS milliseconds.  Must be
+   called before cache_init(). */
+void
+cache_set_flush_interval (int ms)
+{
+  flush_interval = (int64_t) ms * TIMER_FREQ / 1000;
+  if (flush_interval < 1)
+    flush_interval = 1;
+}
+
+/* Makes the flusher write back every dirty entry as soon as more
+   than PERCENT percent of the cache is dirty, or disables that if
+   PERCENT is 0.  Must be called before cache_init(). */
+void
+cache_set_dirty_ratio (unsigned percent)
+{
+  flush_ratio = percent < 100 ? percent : 100;
+}
+
+/* Reserves PERCENT percent of the cache, but no more than
+   META_RESERVE_MAX, for metadata, which file data cannot evict
+   from that share, or removes the reservation if PERCENT is 0.
+   Must be called before cache_init(). */
+void
+cache_set_meta_reserve (unsigned percent)
+{
+  meta_reserve = percent < META_RESERVE_MAX ? percent : META_RESERVE_MAX;
+}
+
+/* Adds a page worth of empty entries to the end of the cache.
+   Returns false if there is no room or no free page.  The caller
+   must hold cache_lock, except during initialization. */
+static bool
+cache_grow (void)
+{
+  size_t per_page = SECTORS_PER_PAGE >> block_shift;
+  char *page;
+  size_t i;
+
+  if (cache_cnt >= cache_max)
+    return false;
+  page = palloc_get_page (0);
+  if (page == NULL)
+    return false;
+
+  for (i = 0; i < per_page; i++)
+    {
+      struct cache_t *c = &cache[cache_cnt + i];
+      c->data = page + (i << block_shift) * BLOCK_SECTOR_SIZE;
+      c->valid = false;
+      c->valid_map = 0;
+      c->dirty_map = 0;
+      c->used = false;
+      cache_free (c);
+    }
+  cache_cnt += per_page;
+  return true;
+}
+
+/* Removes the last page worth of entries from the cache, writing
+   dirty ones back to BLOCK, and frees their page.  The caller
+   must hold cache_lock, which is released during the disk I/O.
+
+   The entries leave the clock first, so nobody starts a transfer
+   into them.  Dirty ones then go through the same write-back
+   protocol as an eviction in cache_get(). */
+static void
+cache_shrink (struct block *block)
+{
+  size_t per_page = SECTORS_PER_PAGE >> block_shift;
+  struct cache_t *victims;
+  char *page;
+  size_t i;
+
+  ASSERT (cache_cnt > per_page);
+
+  cache_resizing = true;
+  cache_cnt -= per_page;
+  if (clock_hand >= cache_cnt)
+    clock_hand = 0;
+  victims = &cache[cache_cnt];
+  page = victims[0].data;
+
+  for (i = 0; i < per_page; i++)
+    while (victims[i].io)
+      cond_wait (&io_done, &cache_lock);
+
+  for (i = 0; i < per_page; i++)
     {
-      cache[i].valid = false;
+      struct cache_t *c = &victims[i];
+
+      lock_acquire (&c->block_lock);
+      c->io = true;
+      cache_writeback_begin (c, c->sector, c->valid ? c->dirty_map : 0);
+      if (c->valid)
+        {
+          list_remove (&c->hash_elem);
+          policy->drop (c);
+          class_cnt[c->class]--;
+        }
+      else
+        queue_remove (c);
+      if (c->valid && c->prefetched)
+        {
+          enum intr_level old_level = spin_lock_irqsave (&stats_lock);
+          prefetch_waste_cnt++;
+          spin_unlock_irqrestore (&stats_lock, old_level);
+        }
+      c->valid = false;
+      c->valid_map = 0;
+      c->prefetched = false;
+      cache_clean (c);
     }
   lock_release (&cache_lock);
+
+  for (i = 0; i < per_page; i++)
+    if (victims[i].writeback_map)
+      {
+        size_t cnt = cache_transfer (block, victims[i].old_sector,
+                                     victims[i].data,
+                                     victims[i].writeback_map, true);
+        cache_count_writeback (victims[i].class, cnt);
+      }
+
+  lock_acquire (&cache_lock);
+  for (i = 0; i < per_page; i++)
+    {
+      struct cache_t *c = &victims[i];
+
+      cache_writeback_end (c);
+      c->io = false;
+      c->data = NULL;
+      lock_release (&c->block_lock);
+    }
+  cond_broadcast (&io_done, &cache_lock);
+  palloc_free_page (page);
+  shrink_cnt++;
+  cache_resizing = false;
+}
+
+/* Returns true if an entry of the last page of the cache holds a
+   delayed block, which cache_shrink() could not write back.  The
+   caller must hold cache_lock. */
+static bool
+cache_page_delayed (void)
+{
+  size_t i;
+
+  for (i = cache_cnt - (SECTORS_PER_PAGE >> block_shift); i < cache_cnt; i++)
+    if (cache[i].valid && cache_delayed (cache[i].sector))
+      return true;
+  return false;
+}
+
+/* Grows or shrinks the cache by a page according to the amount of
+   free memory in the kernel pool, if it has room to change size.
+   The caller must hold cache_lock.  Returns true if cache_lock was
+   released in the meantime, in which case the caller must look
+   its sector up again. */
+static bool
+cache_autosize (struct block *block)
+{
+  size_t free_pages;
+
+  if (cache_min == cache_max || cache_resizing)
+    return false;
+
+  free_pages = palloc_free_cnt (0);
+  if (free_pages > CACHE_GROW_FREE && cache_cnt < cache_max)
+    {
+      if (cache_grow ())
+        grow_cnt++;
+    }
+  else if (free_pages < CACHE_SHRINK_FREE && cache_cnt > cache_min
+           && !cache_page_delayed ())
+    {
+      cache_shrink (block);
+      return true;
+    }
+  return false;
 }
 
 void
 cache_init (void)
 {
+  size_t i;
+
   lock_init (&cache_lock);
-  clock_hand = 0;
+  lock_set_name (&cache_lock, "cache");
+  cond_init (&io_done);
 
   total_cnt = 0;
   hit_cnt = 0;
 
-  int i;
-  for (i = 0; i < CACHE_SIZE; ++i)
-    lock_init (&cache[i].block_lock);
+  if (max_sectors < min_sectors)
+    max_sectors = min_sectors;
+  cache_min = min_sectors >> block_shift;
+  cache_max = max_sectors >> block_shift;
+  cache = calloc (cache_max, sizeof *cache);
+  for (cache_bucket_cnt = 1; cache_bucket_cnt < cache_max; )
+    cache_bucket_cnt *= 2;
+  cache_index = malloc (cache_bucket_cnt * sizeof *cache_index);
+  ghost_index = malloc (cache_bucket_cnt * sizeof *ghost_index);
+  ghosts = malloc (cache_max * sizeof *ghosts);
+  cache_trace = malloc (CACHE_TRACE_SIZE * sizeof *cache_trace);
+  if (cache == NULL || cache_index == NULL || ghost_index == NULL
+      || ghosts == NULL || cache_trace == NULL)
+    PANIC ("Not enough memory for a %zu-sector buffer cache.", max_sectors);
+
+  for (i = 0; i < cache_bucket_cnt; ++i)
+    list_init (&cache_index[i]);
+  list_init (&writeback_list);
+  for (i = 0; i < cache_max; ++i)
+    {
+      lock_init (&cache[i].block_lock);
+      lock_set_name (&cache[i].block_lock, "cache block");
+    }
+  list_init (&free_entries);
+  policy->init ();
+
+  cache_cnt = 0;
+  while (cache_cnt < cache_min)
+    if (!cache_grow ())
+      PANIC ("Not enough memory for a %zu-sector buffer cache.", min_sectors);
+
+  flush_sectors = malloc (cache_max * sizeof *flush_sectors);
+  if (flush_sectors == NULL)
+    PANIC ("Not enough memory for a %zu-sector buffer cache.", max_sectors);
+  sema_init (&flush_wakeup, 0);
+  thread_create ("flusher", PRI_DEFAULT, flusher, NULL);
+
+  lock_init (&move_lock);
+  lock_set_name (&move_lock, "cache move");
+
+  lock_init (&prefetch_lock);
+  sema_init (&prefetch_avail, 0);
+  thread_create ("readahead", PRI_DEFAULT, readahead, NULL);
 }
 
-/* Close the cache and write all dirty blocks back to BLOCK. */
+/* Prints buffer cache statistics. */
+void
+cache_print_stats (void)
+{
+  static const char *class_names[CACHE_CLASS_CNT] =
+    {"inode", "index", "dir", "data"};
+  size_t i;
+
+  printf ("Cache: %zu sectors (%zu to %zu) in %zu-sector blocks, "
+          "%s replacement, grown %u times, shrunk %u times\n",
+          cache_cnt << block_shift, min_sectors, max_sectors,
+          cache_block_sectors (), policy->name, grow_cnt, shrink_cnt);
+  printf ("Cache: %zu blocks dirty, flusher wrote %u sectors in %u passes\n",
+          dirty_cnt, flush_write_cnt, flush_pass_cnt);
+  printf ("Cache: %u sectors prefetched, %u prefetch hits, %u wasted\n",
+          prefetch_cnt, prefetch_hit_cnt, prefetch_waste_cnt);
+  printf ("Cache: %u full-sector writes skipped the read\n", overwrite_cnt);
+  for (i = 0; i < CACHE_CLASS_CNT; i++)
+    printf ("Cache: %-5s %zu blocks, %u hits, %u read-ahead hits, "
+            "%u misses, %u evictions, %u write-backs\n",
+            class_names[i], class_cnt[i], class_stats[i].hits,
+            class_stats[i].readahead_hits, class_stats[i].misses,
+            class_stats[i].evictions, class_stats[i].writebacks);
+}
+
+/* Close the cache and write all dirty blocks back to BLOCK, except
+   delayed ones, which have nowhere to go yet.  Transfers already
+   in progress, such as write-backs by the flusher or by eviction,
+   are waited for, so that everything is on disk on return.  Each
+   entry written is held in I/O state, as in cache_flush_sector(),
+   so that it cannot be evicted or reloaded meanwhile, and under
+   its block lock, so that writers cannot change it mid-transfer. */
 void
 cache_close (struct block *block)
 {
+  size_t i;
+
   lock_acquire (&cache_lock);
+  for (i = 0; i < cache_cnt; ++i)
+    {
+      struct cache_t *c = &cache[i];
+
+      while (c->io)
+        cond_wait (&io_done, &cache_lock);
+      if (!c->valid || !c->dirty_map || cache_delayed (c->sector))
+        continue;
+      c->io = true;
+      lock_release (&cache_lock);
+
+      lock_acquire (&c->block_lock);
+      if (c->dirty_map)
+        {
+          size_t cnt = cache_transfer (block, c->sector, c->data,
+                                       c->dirty_map, true);
+          cache_count_writeback (c->class, cnt);
+          cache_clean (c);
+        }
+      lock_release (&c->block_lock);
+
+      lock_acquire (&cache_lock);
+      c->io = false;
+      cond_broadcast (&io_done, &cache_lock);
+    }
+  lock_release (&cache_lock);
+}
+
+/* Writes the dirty sectors of the block starting at SECTOR back to
+   BLOCK if it is cached, and marks it clean.  The entry is held in
+   I/O state, so it cannot be evicted, and its dirty sectors are
+   copied out to FLUSH_BUF under its block lock so that writers
+   are not held up by the disk write.  Only the flusher thread
+   calls this. */
+static void
+cache_flush_sector (struct block *block, block_sector_t sector)
+{
+  struct cache_t *c;
+  enum cache_class class;
+  unsigned write;
+
+  lock_acquire (&cache_lock);
+  c = cache_lookup (sector);
+  if (c == NULL || c->io)
+    {
+      lock_release (&cache_lock);
+      return;
+    }
+  c->io = true;
+  lock_release (&cache_lock);
+
+  lock_acquire (&c->block_lock);
+  write = c->valid ? c->dirty_map : 0;
+  class = c->class;
+  if (write)
+    {
+      memcpy (flush_buf, c->data, BLOCK_SECTOR_SIZE << block_shift);
+      cache_clean (c);
+    }
+  lock_release (&c->block_lock);
+
+  if (write)
+    {
+      size_t cnt = cache_transfer (block, sector, flush_buf, write, true);
+      cache_count_writeback (class, cnt);
+      flush_write_cnt += cnt;
+    }
+
+  lock_acquire (&cache_lock);
+  c->io = false;
+  cond_broadcast (&io_done, &cache_lock);
+  lock_release (&cache_lock);
+}
+
+/* Compares the sectors pointed to by A and B for qsort(). */
+static int
+compare_sectors (const void *a_, const void *b_)
+{
+  const block_sector_t *a = a_;
+  const block_sector_t *b = b_;
+
+  return *a < *b ? -1 : *a > *b;
+}
+
+/* Writes back to BLOCK every dirty entry if ALL is true, otherwise
+   those that have been dirty for long enough, in ascending sector
+   order. */
+static void
+cache_flush (struct block *block, bool all)
+{
+  int64_t expire = flush_interval * FLUSH_EXPIRE_INTERVALS;
+  int64_t now = timer_ticks ();
+  size_t cnt = 0;
+  size_t i;
+
+  lock_acquire (&cache_lock);
+  for (i = 0; i < cache_cnt; i++)
+    {
+      struct cache_t *c = &cache[i];
+      if (c->valid && c->dirty_map && !c->io && !cache_delayed (c->sector)
+          && (all || now - c->dirtied_at >= expire))
+        flush_sectors[cnt++] = c->sector;
+    }
+  lock_release (&cache_lock);
 
-  int i;
-  for (i = 0; i < CACHE_SIZE; ++i)
-    if (cache[i].valid && cache[i].dirty)
-      block_write (block, cache[i].sector, cache[i].data);
+  qsort (flush_sectors, cnt, sizeof *flush_sectors, compare_sectors);
+  for (i = 0; i < cnt; i++)
+    cache_flush_sector (block, flush_sectors[i]);
+  flush_pass_cnt++;
+}
+
+/* Flusher thread.  Writes dirty entries back every flush_interval
+   ticks, or sooner when woken by cache_mark_dirty(), after
+   allocating delayed blocks and writing the changes to the free
+   map since the last pass. */
+static void
+flusher (void *aux UNUSED)
+{
+  for (;;)
+    {
+      bool all = sema_down_timeout (&flush_wakeup, flush_interval);
+      flush_all = false;
+      inode_flush_delayed ();
+      free_map_flush ();
+      cache_flush (get_fs_device (), all);
+    }
+}
+
+/* Returns true if the old contents of the block starting at SECTOR
+   are still being written back by an entry that has already been
+   given to another block.  The caller must hold cache_lock. */
+static bool
+cache_writeback_pending (block_sector_t sector)
+{
+  struct list_elem *e;
 
+  for (e = list_begin (&writeback_list); e != list_end (&writeback_list);
+       e = list_next (e))
+    if (list_entry (e, struct cache_t, writeback_elem)->old_sector == sector)
+      return true;
+  return false;
+}
+
+/* Reads the sectors in LOAD into cache entry C, which the caller
+   has marked as in I/O and whose block lock it holds, adds them to
+   C's valid map, and then ends the transfer.  START is the tick at
+   which the caller began to wait for C, for the miss latency, and
+   OVERWRITTEN the number of sectors the caller will overwrite
+   without reading them. */
+static void
+cache_load (struct block *block, struct cache_t *c, unsigned load,
+            enum cache_class class, enum cache_get_flags flags,
+            int64_t start, size_t overwritten)
+{
+  enum intr_level old_level;
+
+  cache_transfer (block, c->sector, c->data, load, false);
+  c->valid_map |= load;
+
+  /* Nobody waits for a prefetch, so it adds no miss latency. */
+  old_level = spin_lock_irqsave (&stats_lock);
+  overwrite_cnt += overwritten;
+  if (!(flags & GET_PREFETCH))
+    class_stats[class].miss_ticks += timer_ticks () - start;
+  spin_unlock_irqrestore (&stats_lock, old_level);
+
+  lock_acquire (&cache_lock);
+  c->io = false;
+  cond_broadcast (&io_done, &cache_lock);
   lock_release (&cache_lock);
 }
 
-/* Returns the cache block that contains data corresponding to SECTOR.
- * This function also ensures to acquire the lock to the cache block.
- * If SECTOR cannot be found in the cache, a block will be evicted
- * using clock algorithm, and write back the data if dirty. Caller
- * should call CACHE_DONE after it finished its read or write to
- * release the block lock. */
+/* Returns the cache block that contains data corresponding to the
+ * CNT sectors starting at SECTOR, which must all lie in one cache
+ * block, with all of them read in.  This function also ensures to
+ * acquire the lock to the cache block.  If the block cannot be
+ * found in the cache, an entry will be evicted by the replacement
+ * policy, and its dirty sectors written back.  Caller should call
+ * CACHE_DONE after it finished its read or write to release the
+ * block lock.
+ *
+ * CACHE_LOCK is never held across disk I/O.  On a miss, the victim
+ * is marked as in I/O and entered in the index under its new block
+ * with its block lock held, and then CACHE_LOCK is dropped for the
+ * transfers.  Threads that want the block meanwhile wait on the
+ * block lock alone, and threads that want other cached blocks are
+ * not delayed.  A thread that wants the victim's old block waits
+ * for the write-back to finish before reading it from disk.  A
+ * cached block that lacks some of the sectors wanted is filled in
+ * the same way, by the thread that marks it as in I/O.
+ *
+ * A miss reads in the whole block with one device request.  Sets
+ * *HIT to whether all CNT sectors were found in the cache.  Unless
+ * FLAGS has GET_PREFETCH, the entry is tagged as holding CLASS.  If
+ * the block has to be loaded and FLAGS has GET_PREFETCH, the entry
+ * is marked as prefetched.  With GET_OVERWRITE the caller promises
+ * to overwrite all CNT sectors before releasing the entry, so those
+ * that are missing are not read from disk and their data is
+ * garbage. */
 struct cache_t *
-cache_get (struct block *block, block_sector_t sector)
+cache_get (struct block *block, block_sector_t sector, size_t cnt,
+           enum cache_class class, enum cache_get_flags flags, bool *hit)
 {
-  lock_acquire(&cache_lock);
-  int i;
-  for (i = 0; i < CACHE_SIZE; ++i)
-    if (cache[i].valid && cache[i].sector == sector)
-      {
-        lock_acquire (&cache[i].block_lock);
-        hit_cnt++;
-        lock_release(&cache_lock);
-        return &cache[i];
-      }
+  block_sector_t base = sector >> block_shift << block_shift;
+  unsigned need = ((1u << cnt) - 1) << (sector - base);
+  unsigned full = cache_block_map (block, base);
+  struct cache_t *cache_block;
+  int64_t start;
+
+  ASSERT (cnt > 0 && sector - base + cnt <= cache_block_sectors ());
 
-  /* Cache not found. Evict using clock algorithm. */
-  while (cache[clock_hand].valid && cache[clock_hand].used)
+  lock_acquire (&cache_lock);
+  for (;;)
     {
-      cache[clock_hand].used = false;
-      clock_hand = (clock_hand + 1) % CACHE_SIZE;
+      cache_block = cache_lookup (base);
+      if (cache_block != NULL)
+        {
+          /* Whoever marks the entry as in I/O reads in the sectors
+             it lacks. */
+          bool fill = ((cache_block->valid_map & need) != need
+                       && !(flags & GET_OVERWRITE));
+          if (fill)
+            {
+              if (cache_block->io)
+                {
+                  cond_wait (&io_done, &cache_lock);
+                  continue;
+                }
+              cache_block->io = true;
+            }
+          if (!(flags & GET_PREFETCH))
+            {
+              policy->touch (cache_block);
+              class_cnt[cache_block->class]--;
+              cache_block->class = class;
+              class_cnt[class]++;
+            }
+          lock_release (&cache_lock);
+
+          /* Wait out any transfer without holding CACHE_LOCK, then
+             make sure the entry was not given to another block, or
+             reloaded with fewer sectors, in the meantime.  An entry
+             we marked as in I/O cannot have been. */
+          start = timer_ticks ();
+          lock_acquire (&cache_block->block_lock);
+          if (fill)
+            {
+              cache_load (block, cache_block,
+                          full & ~cache_block->valid_map, class, flags,
+                          start, 0);
+              *hit = false;
+              return cache_block;
+            }
+          if (cache_block->valid && cache_block->sector == base
+              && ((cache_block->valid_map & need) == need
+                  || (flags & GET_OVERWRITE)))
+            {
+              unsigned missing = need & ~cache_block->valid_map;
+              if (missing != 0)
+                {
+                  enum intr_level old_level
+                    = spin_lock_irqsave (&stats_lock);
+                  overwrite_cnt += map_cnt (missing);
+                  spin_unlock_irqrestore (&stats_lock, old_level);
+                  cache_block->valid_map |= missing;
+                }
+              *hit = missing == 0;
+              return cache_block;
+            }
+          lock_release (&cache_block->block_lock);
+
+          lock_acquire (&cache_lock);
+          continue;
+        }
+
+      if (cache_writeback_pending (base))
+        {
+          cond_wait (&io_done, &cache_lock);
+          continue;
+        }
+
+      if (cache_autosize (block))
+        continue;
+      cache_block = cache_victim (base, class);
+      if (cache_block != NULL)
+        break;
+      cond_wait (&io_done, &cache_lock);
     }
 
-  struct cache_t *cache_block = &cache[clock_hand];
+  /* Nobody holds the victim's block lock across disk I/O or while
+     acquiring CACHE_LOCK, so this wait is short. */
+  lock_acquire (&cache_block->block_lock);
 
   /* Save info about evicted block. */
-  bool write_back = cache_block->valid && cache_block->dirty;
+  unsigned write_back = cache_block->valid ? cache_block->dirty_map : 0;
   block_sector_t old_sector = cache_block->sector;
-
-  lock_acquire (&cache_block->block_lock);
+  enum cache_class old_class = cache_block->class;
+  start = timer_ticks ();
 
   /* Update the metadate before releasing the global cache lock. */
-  cache_block->sector = sector;
+  if (cache_block->valid)
+    {
+      enum intr_level old_level = spin_lock_irqsave (&stats_lock);
+      class_stats[old_class].evictions += map_cnt (cache_block->valid_map);
+      if (cache_block->prefetched)
+        prefetch_waste_cnt++;
+      spin_unlock_irqrestore (&stats_lock, old_level);
+
+      list_remove (&cache_block->hash_elem);
+      class_cnt[old_class]--;
+    }
+  cache_block->prefetched = (flags & GET_PREFETCH) != 0;
+  cache_block->sector = base;
+  cache_block->class = class;
+  class_cnt[class]++;
   cache_block->valid = true;
+  cache_block->valid_map = 0;
+  cache_clean (cache_block);
   cache_block->used = true;
+  cache_block->io = true;
+  cache_writeback_begin (cache_block, old_sector, write_back);
+  list_push_front (cache_bucket (base), &cache_block->hash_elem);
+  policy->load (cache_block);
+  lock_release (&cache_lock);
 
   /* Write back if necessary. */
   if (write_back)
-    block_write (block, old_sector, cache_block->data);
+    {
+      size_t written = cache_transfer (block, old_sector, cache_block->data,
+                                       write_back, true);
+      cache_count_writeback (old_class, written);
+      lock_acquire (&cache_lock);
+      cache_writeback_end (cache_block);
+      cond_broadcast (&io_done, &cache_lock);
+      lock_release (&cache_lock);
+    }
 
   /* Grab new block. */
-  block_read (block, sector, cache_block->data);
+  if (flags & GET_OVERWRITE)
+    {
+      cache_block->valid_map = need;
+      cache_load (block, cache_block, 0, class, flags, start, cnt);
+    }
+  else
+    cache_load (block, cache_block, full, class, flags, start, 0);
 
-  lock_release(&cache_lock);
+  *hit = false;
   return cache_block;
 }
 
@@ -134,31 +1655,331 @@ cache_done (struct cache_t *cache_block)
   lock_release (&cache_block->block_lock);
 }
 
-void
-cache_read (struct block *block, block_sector_t sector, void *buffer,
-            int offset, int size)
+/* Counts an access to SECTOR and any following sectors in
+   CACHE_BLOCK, whose block lock the caller holds, in the hit rate,
+   and records SECTOR in the trace.  An access counts once however
+   many sectors of the block it covers.  HIT says whether
+   cache_get() found them all.  A hit on a prefetched entry not
+   touched yet is a read-ahead hit, not an ordinary one. */
+static void
+cache_count (struct cache_t *cache_block, block_sector_t sector, bool hit)
 {
-  ASSERT (offset + size <= BLOCK_SECTOR_SIZE);
+  struct cache_class_stats *stats = &class_stats[cache_block->class];
+  enum intr_level old_level = spin_lock_irqsave (&stats_lock);
+
+  if (!trace_paused && trace_cnt < CACHE_TRACE_SIZE
+      && !cache_delayed (sector))
+    {
+      cache_trace[trace_cnt].sector = sector;
+      cache_trace[trace_cnt].class = cache_block->class;
+      trace_cnt++;
+    }
   total_cnt++;
-  struct cache_t *cache_block = cache_get (block, sector);
+  if (!hit)
+    stats->misses++;
+  else if (cache_block->prefetched)
+    {
+      prefetch_hit_cnt++;
+      stats->readahead_hits++;
+    }
+  else
+    {
+      hit_cnt++;
+      stats->hits++;
+    }
+  spin_unlock_irqrestore (&stats_lock, old_level);
+  cache_block->prefetched = false;
+}
+
+/* Returns the data of SECTOR in CACHE_BLOCK. */
+static char *
+cache_data (struct cache_t *cache_block, block_sector_t sector)
+{
+  return cache_block->data
+         + (sector - cache_block->sector) * BLOCK_SECTOR_SIZE;
+}
+
+/* Advances *SECTOR to the sector that holds byte *OFFSET counted
+   from its start, and makes *OFFSET relative to that sector.
+   Returns the number of sectors, starting at the new *SECTOR, that
+   the SIZE bytes from there touch.  They must all lie in one cache
+   block. */
+static size_t
+cache_span (block_sector_t *sector, int *offset, int size)
+{
+  size_t cnt;
+
+  ASSERT (*offset >= 0 && size >= 0);
+  *sector += *offset / BLOCK_SECTOR_SIZE;
+  *offset %= BLOCK_SECTOR_SIZE;
+  cnt = size > 0 ? (*offset + size - 1) / BLOCK_SECTOR_SIZE + 1 : 1;
+  ASSERT ((*sector & (cache_block_sectors () - 1)) + cnt
+          <= cache_block_sectors ());
+  return cnt;
+}
+
+/* Copies SIZE bytes starting OFFSET bytes into SECTOR of BLOCK to
+   BUFFER.  The bytes may run past the end of SECTOR as far as the
+   end of its cache block, so that a large read of consecutive
+   sectors takes one cache access per block. */
+void
+cache_read (struct block *block, block_sector_t sector,
+            enum cache_class class, void *buffer, int offset, int size)
+{
+  size_t cnt = cache_span (&sector, &offset, size);
+  bool hit;
+  struct cache_t *cache_block = cache_get (block, sector, cnt, class, 0,
+                                           &hit);
+  cache_count (cache_block, sector, hit);
 
   cache_block->used = true;
-  memcpy (buffer, cache_block->data + offset, size);
+  memcpy (buffer, cache_data (cache_block, sector) + offset, size);
 
   cache_done (cache_block);
 }
 
+/* Like cache_read(), but not counted in the hit rate, and does not
+   count as touching a prefetched entry.  For lookups made on
+   behalf of read-ahead. */
 void
-cache_write (struct block *block, block_sector_t sector, const void *buffer,
-             int offset, int size)
+cache_peek (struct block *block, block_sector_t sector,
+            enum cache_class class, void *buffer, int offset, int size)
 {
-  ASSERT (offset + size <= BLOCK_SECTOR_SIZE);
-  total_cnt++;
-  struct cache_t *cache_block = cache_get (block, sector);
+  size_t cnt = cache_span (&sector, &offset, size);
+  bool hit;
+  struct cache_t *cache_block = cache_get (block, sector, cnt, class, 0,
+                                           &hit);
+
+  memcpy (buffer, cache_data (cache_block, sector) + offset, size);
+
+  cache_done (cache_block);
+}
+
+/* Asks the readahead thread to load SECTOR from BLOCK into the
+   cache.  Never blocks on disk I/O; the request is dropped if too
+   many are already queued, or if SECTOR is delayed, since it may
+   be gone by the time the request is served. */
+void
+cache_prefetch (struct block *block, block_sector_t sector)
+{
+  bool queued = false;
+
+  if (cache_delayed (sector))
+    return;
+
+  lock_acquire (&prefetch_lock);
+  if (prefetch_len < PREFETCH_QUEUE_SIZE)
+    {
+      struct prefetch_req *req
+        = &prefetch_queue[(prefetch_head + prefetch_len++)
+                          % PREFETCH_QUEUE_SIZE];
+      req->block = block;
+      req->sector = sector;
+      queued = true;
+    }
+  lock_release (&prefetch_lock);
+
+  if (queued)
+    sema_up (&prefetch_avail);
+}
+
+/* Readahead thread.  Loads the sectors queued by cache_prefetch()
+   in the order they were requested. */
+static void
+readahead (void *aux UNUSED)
+{
+  for (;;)
+    {
+      struct prefetch_req req;
+      struct cache_t *cache_block;
+      bool hit;
+
+      sema_down (&prefetch_avail);
+      lock_acquire (&prefetch_lock);
+      req = prefetch_queue[prefetch_head];
+      prefetch_head = (prefetch_head + 1) % PREFETCH_QUEUE_SIZE;
+      prefetch_len--;
+      lock_release (&prefetch_lock);
+
+      cache_block = cache_get (req.block, req.sector, 1, CACHE_DATA,
+                               GET_PREFETCH, &hit);
+      if (!hit)
+        {
+          enum intr_level old_level = spin_lock_irqsave (&stats_lock);
+          prefetch_cnt++;
+          spin_unlock_irqrestore (&stats_lock, old_level);
+        }
+      cache_done (cache_block);
+    }
+}
+
+/* Replays the demand accesses recorded since the last
+   cache_reset() through a cold cache run by the replacement
+   policy named NAME, and returns the percentage of them that
+   hit.  Returns -1 if there is no such policy.  The cache is left
+   empty and back on its own policy.  Replayed accesses are not
+   counted in the hit rate, and dirty entries are written back
+   first, so the file system is not affected. */
+int
+cache_replay (const char *name)
+{
+  const struct cache_policy *p = cache_find_policy (name);
+  const struct cache_policy *saved = policy;
+  struct block *block = get_fs_device ();
+  size_t hits = 0;
+  size_t cnt;
+  size_t i;
+
+  if (p == NULL)
+    return -1;
+
+  inode_flush_delayed ();
+  free_map_flush ();
+  cache_close (block);
+  lock_acquire (&cache_lock);
+  trace_paused = true;
+  cnt = trace_cnt;
+  cache_invalidate (p);
+  lock_release (&cache_lock);
+
+  for (i = 0; i < cnt; i++)
+    {
+      bool hit;
+      struct cache_t *cache_block = cache_get (block, cache_trace[i].sector,
+                                               1, cache_trace[i].class, 0,
+                                               &hit);
+      cache_block->used = true;
+      if (hit)
+        hits++;
+      cache_done (cache_block);
+    }
+
+  cache_close (block);
+  lock_acquire (&cache_lock);
+  cache_invalidate (saved);
+  trace_paused = false;
+  lock_release (&cache_lock);
+
+  return cnt > 0 ? hits * 100 / cnt : 0;
+}
+
+/* Returns the number of sectors loaded by read-ahead, the number
+   of accesses they served, and the number evicted untouched,
+   since the last cache_reset(). */
+void
+get_prefetch_stats (unsigned *prefetched, unsigned *hits, unsigned *wasted)
+{
+  enum intr_level old_level = spin_lock_irqsave (&stats_lock);
+  *prefetched = prefetch_cnt;
+  *hits = prefetch_hit_cnt;
+  *wasted = prefetch_waste_cnt;
+  spin_unlock_irqrestore (&stats_lock, old_level);
+}
+
+/* Does the work of cache_write(), counting the access in the hit
+   rate only if COUNT is true. */
+static void
+cache_store (struct block *block, block_sector_t sector,
+             enum cache_class class, const void *buffer, int offset,
+             int size, bool count)
+{
+  size_t cnt = cache_span (&sector, &offset, size);
+  bool hit;
+  enum cache_get_flags flags = 0;
+  if (offset == 0 && size > 0 && size % BLOCK_SECTOR_SIZE == 0)
+    flags |= GET_OVERWRITE;
+  struct cache_t *cache_block = cache_get (block, sector, cnt, class, flags,
+                                           &hit);
+  if (count)
+    cache_count (cache_block, sector, hit);
 
   cache_block->used = true;
-  memcpy (cache_block->data + offset, buffer, size);
-  cache_block->dirty = true;
+  memcpy (cache_data (cache_block, sector) + offset, buffer, size);
+  cache_mark_dirty (cache_block,
+                    ((1u << cnt) - 1) << (sector - cache_block->sector));
 
   cache_done (cache_block);
 }
+
+/* Copies SIZE bytes from BUFFER to SECTOR of BLOCK, starting
+   OFFSET bytes into it.  As with cache_read(), the bytes may run
+   on into the following sectors of the same cache block.  Sectors
+   that are overwritten whole are not read from disk first.  A
+   delayed SECTOR must be written whole the first time. */
+void
+cache_write (struct block *block, block_sector_t sector,
+             enum cache_class class, const void *buffer, int offset,
+             int size)
+{
+  cache_store (block, sector, class, buffer, offset, size, true);
+}
+
+/* Returns a sector number, from CACHE_DELAYED up, that is not in
+   use to stand for a new delayed block.  Each is the first sector
+   of a cache block of its own. */
+block_sector_t
+cache_delayed_sector (void)
+{
+  static block_sector_t next = CACHE_DELAYED;
+  block_sector_t sector;
+
+  lock_acquire (&cache_lock);
+  sector = next;
+  next += cache_block_sectors ();
+  if (next < CACHE_DELAYED)
+    next = CACHE_DELAYED;
+  lock_release (&cache_lock);
+  return sector;
+}
+
+/* Returns how many delayed blocks may be cached at once: a quarter
+   of the cache's minimum size, so that they can never crowd out
+   every entry that could be evicted. */
+size_t
+cache_delayed_limit (void)
+{
+  return cache_min / 4 > 0 ? cache_min / 4 : 1;
+}
+
+/* Moves the data of the delayed block FROM, which must be cached,
+   to sector TO of BLOCK, tagged as CLASS, and drops FROM from the
+   cache.  TO becomes dirty without being read from disk.  Not
+   counted in the hit rate. */
+void
+cache_move (struct block *block, block_sector_t from, block_sector_t to,
+            enum cache_class class)
+{
+  ASSERT (cache_delayed (from) && !cache_delayed (to));
+
+  lock_acquire (&move_lock);
+  cache_peek (block, from, class, move_buf, 0, BLOCK_SECTOR_SIZE);
+  cache_store (block, to, class, move_buf, 0, BLOCK_SECTOR_SIZE, false);
+  lock_release (&move_lock);
+  cache_discard (from);
+}
+
+/* Drops the block starting at SECTOR from the cache without
+   writing it back, if it is cached. */
+void
+cache_discard (block_sector_t sector)
+{
+  struct cache_t *c;
+
+  lock_acquire (&cache_lock);
+  while ((c = cache_lookup (sector)) != NULL && c->io)
+    cond_wait (&io_done, &cache_lock);
+  if (c != NULL)
+    {
+      lock_acquire (&c->block_lock);
+      list_remove (&c->hash_elem);
+      policy->drop (c);
+      class_cnt[c->class]--;
+      c->valid = false;
+      c->valid_map = 0;
+      c->prefetched = false;
+      cache_clean (c);
+      cache_free (c);
+      lock_release (&c->block_lock);
+    }
+  lock_release (&cache_lock);
+}
@@ -1,15 +1,78 @@
 #ifndef GROUP_CACHE_H
 #define GROUP_CACHE_H
 
+#include <stdbool.h>
 #include "devices/block.h"
 
+/* What a cached sector holds.  Metadata classes are protected
+   from eviction by file data up to a reserved share of the
+   cache. */
+enum cache_class
+  {
+    CACHE_INODE,                /* On-disk inode. */
+    CACHE_INDEX,                /* Indirect or doubly indirect block. */
+    CACHE_DIR,                  /* Directory data. */
+    CACHE_DATA,                 /* File data. */
+    CACHE_CLASS_CNT             /* Number of classes. */
+  };
+
+/* Statistics for one class of cached sectors.  The counters
+   cover demand accesses since the last cache_reset(); SECTORS and
+   DIRTY describe the cache now. */
+struct cache_class_stats
+  {
+    unsigned sectors;           /* Sectors now cached. */
+    unsigned dirty;             /* Of those, sectors now dirty. */
+    unsigned hits;              /* Accesses that found the sector. */
+    unsigned readahead_hits;    /* Accesses that found it prefetched. */
+    unsigned misses;            /* Accesses that had to load it. */
+    unsigned evictions;         /* Cached sectors evicted. */
+    unsigned writebacks;        /* Dirty sectors written back. */
+    int64_t miss_ticks;         /* Total ticks spent loading on misses. */
+  };
+
+/* Sectors numbered CACHE_DELAYED and up stand for blocks written
+   under delayed allocation, which have no sector on disk yet.
+   They stay in the cache, which never reads them from disk, writes
+   them back, or evicts them, until cache_move() gives their data a
+   real sector. */
+#define CACHE_DELAYED 0x80000000u
+
+/* Returns true if SECTOR stands for a delayed block. */
+static inline bool
+cache_delayed (block_sector_t sector)
+{
+  return sector >= CACHE_DELAYED;
+}
+
+void cache_set_size (size_t sectors);
+void cache_set_max_size (size_t sectors);
+bool cache_set_block_size (size_t sectors);
+size_t cache_block_sectors (void);
+void cache_set_flush_interval (int ms);
+void cache_set_dirty_ratio (unsigned percent);
+bool cache_set_policy (const char *name);
+void cache_set_meta_reserve (unsigned percent);
 void cache_init (void);
+void cache_print_stats (void);
 void cache_close (struct block *);
-void cache_read (struct block *, block_sector_t, void *buffer,
-                 int offset, int size);
-void cache_write (struct block *, block_sector_t, const void *buffer,
-                  int offset, int size);
+void cache_read (struct block *, block_sector_t, enum cache_class,
+                 void *buffer, int offset, int size);
+void cache_write (struct block *, block_sector_t, enum cache_class,
+                  const void *buffer, int offset, int size);
+void cache_peek (struct block *, block_sector_t, enum cache_class,
+                 void *buffer, int offset, int size);
+void cache_prefetch (struct block *, block_sector_t);
+block_sector_t cache_delayed_sector (void);
+size_t cache_delayed_limit (void);
+void cache_move (struct block *, block_sector_t from, block_sector_t to,
+                 enum cache_class);
+void cache_discard (block_sector_t);
 int get_hit_rate (void);
+void get_class_stats (enum cache_class, struct cache_class_stats *);
+void get_prefetch_stats (unsigned *prefetched, unsigned *hits,
+                         unsigned *wasted);
 void cache_reset (void);
+int cache_replay (const char *policy);
 struct block * get_fs_device (void);
 #endif /* filesys/cache.h */
@@ -28,6 +28,7 @@ dir_init (void)
 {
   list_init (&open_dirs);
   lock_init (&open_dirs_lock);
+  lock_set_name (&open_dirs_lock, "open dirs");
 }
 
 /* Creates a directory with space for ENTRY_CNT entries in the
@@ -57,6 +58,7 @@ dir_open (struct inode *inode)
 {
   if (inode == NULL)
     return NULL;
+  inode_set_class (inode, CACHE_DIR);
 
   lock_acquire (&open_dirs_lock);
 
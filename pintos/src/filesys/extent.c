@@ -0,0 +1,513 @@
+#include "filesys/extent.h"
+#include <debug.h>
+#include <stddef.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/malloc.h"
+
+/* A new extent starts, if possible, with EXTENT_ROOM free sectors
+   after it and, unless it follows the file's preceding extent,
+   before it, so that it and the file before it can both grow even
+   while they grow side by side. */
+#define EXTENT_ROOM 16
+
+/* An extent block, which holds the entries of one node of an
+   extent tree below the root, sorted by LOGICAL.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+#define EXTENT_BLOCK_CNT 42
+struct extent_block
+  {
+    uint32_t cnt;                       /* Entries of EXTENTS in use. */
+    uint32_t unused;                    /* Not used. */
+    struct extent extents[EXTENT_BLOCK_CNT];
+  };
+
+/* A path from the root of an extent tree down to an extent block
+   of the last level. */
+struct extent_path
+  {
+    block_sector_t sector[EXTENT_MAX_DEPTH];    /* Block at each level. */
+    int pos[EXTENT_MAX_DEPTH];                  /* Its entry in its parent. */
+    size_t cnt[EXTENT_MAX_DEPTH];               /* Its entries in use. */
+  };
+
+/* Returns the index of the last of the CNT entries in V, sorted by
+   LOGICAL, that starts at or before file block IDX, or -1 if
+   there is none. */
+static int
+extent_search (const struct extent *v, size_t cnt, size_t idx)
+{
+  int lo = 0, hi = (int) cnt - 1;
+  int found = -1;
+
+  while (lo <= hi)
+    {
+      int mid = (lo + hi) / 2;
+      if (v[mid].logical <= idx)
+        {
+          found = mid;
+          lo = mid + 1;
+        }
+      else
+        hi = mid - 1;
+    }
+  return found;
+}
+
+/* Returns the sector that holds file block IDX according to extent
+   E, or 0 if E does not map IDX. */
+static block_sector_t
+extent_map (const struct extent *e, size_t idx)
+{
+  if (idx >= e->logical && idx - e->logical < e->length)
+    return e->start + (idx - e->logical);
+  return 0;
+}
+
+/* Reads SIZE bytes at OFS in extent block SECTOR into BUFFER,
+   uncounted in the cache hit rate if PEEK is true. */
+static void
+extent_read (block_sector_t sector, void *buffer, size_t ofs, size_t size,
+             bool peek)
+{
+  if (peek)
+    cache_peek (fs_device, sector, CACHE_INDEX, buffer, ofs, size);
+  else
+    cache_read (fs_device, sector, CACHE_INDEX, buffer, ofs, size);
+}
+
+/* Same as extent_search() for the entries of extent block SECTOR,
+   reading one entry at a time through the cache.  Stores the entry
+   found in *E. */
+static int
+extent_block_search (block_sector_t sector, size_t idx, struct extent *e,
+                     bool peek)
+{
+  uint32_t cnt;
+  int lo, hi;
+  int found = -1;
+
+  extent_read (sector, &cnt, offsetof (struct extent_block, cnt),
+               sizeof cnt, peek);
+  lo = 0;
+  hi = (int) cnt - 1;
+  while (lo <= hi)
+    {
+      int mid = (lo + hi) / 2;
+      struct extent probe;
+
+      extent_read (sector, &probe,
+                   offsetof (struct extent_block, extents)
+                   + mid * sizeof probe, sizeof probe, peek);
+      if (probe.logical <= idx)
+        {
+          found = mid;
+          *e = probe;
+          lo = mid + 1;
+        }
+      else
+        hi = mid - 1;
+    }
+  return found;
+}
+
+/* Returns the sector that holds file block IDX according to the
+   extent tree ROOT, or 0 if IDX is in a hole.  Takes a binary
+   search of ROOT and of one extent block per level below it, the
+   latter through the cache, uncounted in the hit rate if PEEK is
+   true. */
+block_sector_t
+extent_lookup (const struct extent_root *root, size_t idx, bool peek)
+{
+  int i = extent_search (root->extents, root->cnt, idx);
+  struct extent e;
+  int level;
+
+  if (i < 0)
+    return 0;
+  e = root->extents[i];
+  for (level = 0; level < root->depth; level++)
+    if (extent_block_search (e.start, idx, &e, peek) < 0)
+      return 0;
+  return extent_map (&e, idx);
+}
+
+/* Inserts E as entry AT of the *CNT entries of V. */
+static void
+extent_insert_at (struct extent *v, size_t *cnt, int at, struct extent e)
+{
+  memmove (&v[at + 1], &v[at], (*cnt - at) * sizeof *v);
+  v[at] = e;
+  (*cnt)++;
+}
+
+/* Maps file block IDX, which must be unmapped, in the *CNT extents
+   of V, which have room for MAX, to sector FIXED, or if FIXED is 0
+   to a newly allocated sector.  Grows the extent that ends just
+   before IDX if the sector after it is FIXED, or is free, and
+   otherwise inserts an extent.  A new sector goes after the
+   preceding extent, or after GOAL if there is none, and is
+   zero-filled.  Returns the sector, or 0 if there is no free
+   sector or no room for another extent. */
+static block_sector_t
+extent_insert (struct extent *v, size_t *cnt, size_t max, size_t idx,
+               block_sector_t goal, block_sector_t fixed)
+{
+  int i = extent_search (v, *cnt, idx);
+  struct extent e;
+
+  if (i >= 0)
+    {
+      goal = v[i].start + v[i].length;
+      if (v[i].logical + v[i].length == idx
+          && (fixed != 0 ? fixed == goal
+              : free_map_calloc_at (goal, CACHE_DATA)))
+        return v[i].start + v[i].length++;
+    }
+
+  if (*cnt >= max)
+    return 0;
+  if (fixed != 0)
+    e.start = fixed;
+  else if (!free_map_calloc_room (goal, EXTENT_ROOM, &e.start, CACHE_DATA))
+    return 0;
+  e.logical = idx;
+  e.length = 1;
+  extent_insert_at (v, cnt, i + 1, e);
+  return e.start;
+}
+
+/* Allocates a zero-filled sector near GOAL for an extent block
+   and stores it in *SECTORP.  If RESERVE is nonnull, takes the
+   sector out of the *RESERVE sectors that the caller set aside
+   with free_map_reserve(), and decrements *RESERVE.  Returns false
+   if no sector is free, or none is left in *RESERVE. */
+static bool
+extent_alloc_block (block_sector_t goal, size_t *reserve,
+                    block_sector_t *sectorp)
+{
+  if (reserve == NULL)
+    return free_map_calloc (goal, 1, sectorp, CACHE_INDEX);
+  if (*reserve == 0
+      || !free_map_calloc_reserved (goal, 1, sectorp, CACHE_INDEX))
+    return false;
+  (*reserve)--;
+  return true;
+}
+
+/* Moves the entries of ROOT down into a new extent block near
+   GOAL, allocated as by extent_alloc_block() with RESERVE, making
+   the tree one level deeper.  Returns false if no sector is
+   free. */
+static bool
+extent_deepen (struct extent_root *root, block_sector_t goal,
+               size_t *reserve)
+{
+  struct extent_block *b;
+  block_sector_t sector;
+
+  ASSERT (sizeof *b == BLOCK_SECTOR_SIZE);
+  ASSERT (root->cnt > 0);
+
+  b = calloc (1, sizeof *b);
+  if (b == NULL || !extent_alloc_block (goal, reserve, &sector))
+    {
+      free (b);
+      return false;
+    }
+  b->cnt = root->cnt;
+  memcpy (b->extents, root->extents, root->cnt * sizeof *root->extents);
+  cache_write (fs_device, sector, CACHE_INDEX, b, 0, sizeof *b);
+  free (b);
+
+  root->extents[0].start = sector;
+  root->extents[0].length = 0;
+  root->cnt = 1;
+  root->depth++;
+  return true;
+}
+
+/* Splits the extent block at LEVEL of PATH in ROOT, moving the
+   upper half of its entries to a new extent block near GOAL,
+   allocated as by extent_alloc_block() with RESERVE, that is
+   entered in its parent after it.  The parent must have room.
+   Returns false if memory or disk allocation fails. */
+static bool
+extent_split (struct extent_root *root, const struct extent_path *path,
+              int level, block_sector_t goal, size_t *reserve)
+{
+  struct extent_block *lower = malloc (sizeof *lower);
+  struct extent_block *upper = calloc (1, sizeof *upper);
+  struct extent e;
+  size_t half;
+  bool success = false;
+
+  if (lower == NULL || upper == NULL
+      || !extent_alloc_block (goal, reserve, &e.start))
+    goto done;
+
+  cache_read (fs_device, path->sector[level], CACHE_INDEX, lower, 0,
+              sizeof *lower);
+  half = lower->cnt / 2;
+  upper->cnt = lower->cnt - half;
+  memcpy (upper->extents, &lower->extents[half],
+          upper->cnt * sizeof *upper->extents);
+  lower->cnt = half;
+  cache_write (fs_device, e.start, CACHE_INDEX, upper, 0, sizeof *upper);
+  cache_write (fs_device, path->sector[level], CACHE_INDEX, lower, 0,
+               sizeof *lower);
+
+  e.logical = upper->extents[0].logical;
+  e.length = 0;
+  if (level == 0)
+    {
+      size_t cnt = root->cnt;
+      extent_insert_at (root->extents, &cnt, path->pos[0] + 1, e);
+      root->cnt = cnt;
+    }
+  else
+    {
+      /* Reuse UPPER for the parent. */
+      block_sector_t parent = path->sector[level - 1];
+      size_t cnt;
+
+      cache_read (fs_device, parent, CACHE_INDEX, upper, 0, sizeof *upper);
+      cnt = upper->cnt;
+      extent_insert_at (upper->extents, &cnt, path->pos[level] + 1, e);
+      upper->cnt = cnt;
+      cache_write (fs_device, parent, CACHE_INDEX, upper, 0, sizeof *upper);
+    }
+  success = true;
+
+ done:
+  free (lower);
+  free (upper);
+  return success;
+}
+
+/* Finds the path in ROOT, which must have depth 1 or more, to the
+   extent block of the last level where file block IDX belongs, and
+   stores it in *PATH.  An IDX before the first entry of a node
+   belongs to that entry, whose LOGICAL is lowered to IDX; sets
+   *ROOT_CHANGED to true if that happens in ROOT. */
+static void
+extent_descend (struct extent_root *root, size_t idx,
+                struct extent_path *path, bool *root_changed)
+{
+  struct extent e;
+  int level;
+  int i;
+
+  i = extent_search (root->extents, root->cnt, idx);
+  if (i < 0)
+    {
+      i = 0;
+      root->extents[0].logical = idx;
+      *root_changed = true;
+    }
+  e = root->extents[i];
+  for (level = 0; level < root->depth; level++)
+    {
+      uint32_t cnt;
+
+      path->sector[level] = e.start;
+      path->pos[level] = i;
+      cache_read (fs_device, e.start, CACHE_INDEX, &cnt,
+                  offsetof (struct extent_block, cnt), sizeof cnt);
+      path->cnt[level] = cnt;
+      if (level + 1 < root->depth)
+        {
+          i = extent_block_search (e.start, idx, &e, false);
+          if (i < 0)
+            {
+              i = 0;
+              cache_read (fs_device, path->sector[level], CACHE_INDEX, &e,
+                          offsetof (struct extent_block, extents),
+                          sizeof e);
+              e.logical = idx;
+              cache_write (fs_device, path->sector[level], CACHE_INDEX, &e,
+                           offsetof (struct extent_block, extents),
+                           sizeof e);
+            }
+        }
+    }
+}
+
+/* Maps file block IDX, which must be in a hole of the extent tree
+   ROOT, to sector FIXED, or if FIXED is 0 to a new sector, as
+   extent_insert() does, adding extent blocks as needed, allocated
+   as by extent_alloc_block() with RESERVE.  Sets *ROOT_CHANGED to
+   true if ROOT itself was modified.  Returns the sector, or 0 if
+   allocation fails. */
+static block_sector_t
+extent_add (struct extent_root *root, size_t idx, block_sector_t goal,
+            block_sector_t fixed, size_t *reserve, bool *root_changed)
+{
+  block_sector_t sector;
+  struct extent_block *b;
+  size_t cnt;
+
+  *root_changed = false;
+  if (root->depth == 0)
+    {
+      cnt = root->cnt;
+      sector = extent_insert (root->extents, &cnt, EXTENT_ROOT_CNT, idx,
+                              goal, fixed);
+      root->cnt = cnt;
+      if (sector != 0 || cnt < EXTENT_ROOT_CNT)
+        {
+          *root_changed = sector != 0;
+          return sector;
+        }
+      if (!extent_deepen (root, goal, reserve))
+        return 0;
+      *root_changed = true;
+    }
+
+  b = malloc (sizeof *b);
+  if (b == NULL)
+    return 0;
+  for (;;)
+    {
+      struct extent_path path;
+      int leaf = root->depth - 1;
+      int level;
+
+      extent_descend (root, idx, &path, root_changed);
+      cache_read (fs_device, path.sector[leaf], CACHE_INDEX, b, 0,
+                  sizeof *b);
+      cnt = b->cnt;
+      sector = extent_insert (b->extents, &cnt, EXTENT_BLOCK_CNT, idx,
+                              goal, fixed);
+      if (sector != 0)
+        {
+          b->cnt = cnt;
+          cache_write (fs_device, path.sector[leaf], CACHE_INDEX, b, 0,
+                       sizeof *b);
+          break;
+        }
+      if (cnt < EXTENT_BLOCK_CNT)
+        break;
+
+      /* The extent block is full.  Split the lowest full block on
+         the path whose parent has room, or if every one is full,
+         deepen the tree, and try again. */
+      for (level = leaf; level > 0; level--)
+        if (path.cnt[level - 1] < EXTENT_BLOCK_CNT)
+          break;
+      if (level == 0 && root->cnt >= EXTENT_ROOT_CNT)
+        {
+          if (root->depth >= EXTENT_MAX_DEPTH
+              || !extent_deepen (root, goal, reserve))
+            break;
+        }
+      else if (!extent_split (root, &path, level, goal, reserve))
+        break;
+      *root_changed = true;
+    }
+  free (b);
+  return sector;
+}
+
+/* Returns the sector that holds file block IDX according to the
+   extent tree ROOT, allocating a zero-filled sector for it first
+   if IDX is in a hole.  New sectors go after the file's preceding
+   block where possible, or else after GOAL, the sector of the
+   inode.  Sets *ROOT_CHANGED to true if ROOT itself was modified,
+   in which case the caller must write it back.  Returns 0 if
+   allocation fails.  The caller must hold the inode's lock for
+   writing. */
+block_sector_t
+extent_create (struct extent_root *root, size_t idx, block_sector_t goal,
+               bool *root_changed)
+{
+  block_sector_t sector = extent_lookup (root, idx, false);
+
+  *root_changed = false;
+  if (sector != 0)
+    return sector;
+  return extent_add (root, idx, goal, 0, NULL, root_changed);
+}
+
+/* Maps file block IDX, which must be in a hole of the extent tree
+   ROOT, to SECTOR, which the caller has already allocated.  Takes
+   the sectors of any extent blocks it adds, at most
+   EXTENT_ADD_BLOCKS, out of the *RESERVE sectors that the caller
+   set aside with free_map_reserve(), and decrements *RESERVE by
+   their number.  GOAL, ROOT_CHANGED, and the locking are as for
+   extent_create().  Returns false if an extent block could not be
+   allocated. */
+bool
+extent_set (struct extent_root *root, size_t idx, block_sector_t sector,
+            block_sector_t goal, size_t *reserve, bool *root_changed)
+{
+  ASSERT (sector != 0);
+  return extent_add (root, idx, goal, sector, reserve, root_changed) != 0;
+}
+
+/* Maps file blocks 0 through CNT - 1 of the empty extent tree ROOT
+   to one run of CNT consecutive zero-filled sectors after GOAL, the
+   sector of the inode.  Returns false, leaving ROOT empty, if there
+   is no such run. */
+bool
+extent_prealloc (struct extent_root *root, size_t cnt, block_sector_t goal)
+{
+  ASSERT (root->cnt == 0 && cnt > 0);
+
+  if (!free_map_calloc (goal, cnt, &root->extents[0].start, CACHE_DATA))
+    return false;
+  root->extents[0].logical = 0;
+  root->extents[0].length = cnt;
+  root->cnt = 1;
+  return true;
+}
+
+/* Releases the sectors of every extent in the CNT extents of V. */
+static void
+extent_release (const struct extent *v, size_t cnt)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    free_map_release (v[i].start, v[i].length);
+}
+
+/* Releases the sectors mapped by the CNT entries of V, which are
+   at DEPTH levels above the extents, and the extent blocks below
+   them. */
+static void
+extent_release_level (const struct extent *v, size_t cnt, int depth)
+{
+  struct extent_block *b;
+  size_t i;
+
+  if (depth == 0)
+    {
+      extent_release (v, cnt);
+      return;
+    }
+
+  b = malloc (sizeof *b);
+  if (b == NULL)
+    PANIC ("out of memory freeing extents");
+  for (i = 0; i < cnt; i++)
+    {
+      cache_read (fs_device, v[i].start, CACHE_INDEX, b, 0, sizeof *b);
+      extent_release_level (b->extents, b->cnt, depth - 1);
+      free_map_release (v[i].start, 1);
+    }
+  free (b);
+}
+
+/* Releases every sector mapped by the extent tree ROOT, and its
+   extent blocks, and leaves ROOT empty.  The caller must hold
+   free_map_lock. */
+void
+extent_free (struct extent_root *root)
+{
+  extent_release_level (root->extents, root->cnt, root->depth);
+  root->cnt = 0;
+  root->depth = 0;
+}
@@ -0,0 +1,51 @@
+#ifndef FILESYS_EXTENT_H
+#define FILESYS_EXTENT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "devices/block.h"
+
+/* LENGTH consecutive sectors, starting at START, that hold file
+   blocks LOGICAL through LOGICAL + LENGTH - 1. */
+struct extent
+  {
+    uint32_t logical;           /* First file block. */
+    block_sector_t start;       /* First sector. */
+    uint32_t length;            /* Number of sectors. */
+  };
+
+/* Root of a file's extent tree, kept in its on-disk inode.  At
+   depth 0, EXTENTS are the file's extents, sorted by LOGICAL, with
+   holes between them for the parts of a sparse file never
+   written.  At greater depths they point to extent blocks: each
+   entry's START is a sector holding up to EXTENT_BLOCK_CNT entries
+   of the next level down, for file blocks LOGICAL and later, and
+   its LENGTH is unused.  The entries of the last level are
+   extents. */
+#define EXTENT_ROOT_CNT 36
+struct extent_root
+  {
+    uint16_t cnt;               /* Entries of EXTENTS in use. */
+    uint16_t depth;             /* Levels of extent blocks. */
+    struct extent extents[EXTENT_ROOT_CNT];
+  };
+
+/* Most levels of extent blocks below a root.  Three are enough for
+   over 2 million extents. */
+#define EXTENT_MAX_DEPTH 3
+
+/* Most extent blocks that mapping one block can allocate: a split
+   at each level and one deepening of the tree. */
+#define EXTENT_ADD_BLOCKS (EXTENT_MAX_DEPTH + 1)
+
+block_sector_t extent_lookup (const struct extent_root *, size_t idx,
+                              bool peek);
+block_sector_t extent_create (struct extent_root *, size_t idx,
+                              block_sector_t goal, bool *root_changed);
+bool extent_set (struct extent_root *, size_t idx, block_sector_t sector,
+                 block_sector_t goal, size_t *reserve, bool *root_changed);
+bool extent_prealloc (struct extent_root *, size_t cnt, block_sector_t goal);
+void extent_free (struct extent_root *);
+
+#endif /* filesys/extent.h */
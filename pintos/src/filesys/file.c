@@ -9,6 +9,7 @@ struct file
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+    struct readahead ra;        /* Sequential read-ahead state. */
   };
 
 /* Opens a file for the given INODE, of which it takes ownership,
@@ -23,6 +24,7 @@ file_open (struct inode *inode)
       file->inode = inode;
       file->pos = 0;
       file->deny_write = false;
+      inode_readahead_init (&file->ra);
       return file;
     }
   else
@@ -69,6 +71,7 @@ off_t
 file_read (struct file *file, void *buffer, off_t size)
 {
   off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  inode_readahead (file->inode, &file->ra, file->pos, bytes_read);
   file->pos += bytes_read;
   return bytes_read;
 }
@@ -24,8 +24,8 @@ filesys_init (bool format)
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
-  cache_init ();
   inode_init ();
+  cache_init ();
   free_map_init ();
   dir_init ();
 
@@ -48,13 +48,20 @@ get_fs_device_write_cnt (void)
   return get_write_cnt (fs_device);
 }
 
+unsigned long long
+get_fs_device_read_cnt (void)
+{
+  return get_read_cnt (fs_device);
+}
+
 /* Shuts down the file system module, writing any unwritten data
    to disk. */
 void
 filesys_done (void)
 {
-  cache_close (fs_device);
+  inode_flush_delayed ();
   free_map_close ();
+  cache_close (fs_device);
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -72,11 +79,11 @@ filesys_create (const char *path, off_t initial_size)
   struct dir *dir = dir_resolve (dir_path);
 
   bool success = (dir != NULL
-                  && free_map_alloc (&inode_sector)
+                  && free_map_alloc (dir_inumber (dir), 1, &inode_sector)
                   && inode_create (inode_sector, initial_size)
                   && dir_add (dir, target, inode_sector, false));
   if (!success && inode_sector != 0)
-    free_map_release (inode_sector);
+    free_map_release (inode_sector, 1);
   dir_close (dir);
 
   free (dir_path);
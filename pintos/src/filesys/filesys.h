@@ -17,5 +17,6 @@ bool filesys_create (const char *name, off_t initial_size);
 bool filesys_open (const char *, void **, bool *);
 bool filesys_remove (const char *name);
 unsigned long long get_fs_device_write_cnt (void);
+unsigned long long get_fs_device_read_cnt (void);
 
 #endif /* filesys/filesys.h */
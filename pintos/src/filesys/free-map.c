@@ -1,16 +1,59 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <limits.h>
+#include <round.h>
+#include <stdio.h>
 #include "filesys/cache.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/malloc.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
 
+/* Sectors of the free map file whose part of FREE_MAP changed since
+   it was last written, one bit per sector.  Allocation only marks
+   them, and free_map_flush() writes them out later. */
+static struct bitmap *free_map_dirty;
+
 static char zeros[BLOCK_SECTOR_SIZE];
 
+/* Allocation groups.  The free map is divided into groups of
+   GROUP_SECTORS sectors, each with a count of its free sectors, so
+   that allocation skips full groups without scanning them. */
+#define GROUP_SECTORS 512
+static size_t group_cnt;             /* Number of groups. */
+static size_t *group_free;           /* Free sectors in each group. */
+
+static size_t free_sectors;          /* Free sectors in all. */
+static size_t reserved_sectors;      /* Of those, set aside for blocks
+                                        allocated later. */
+
+/* Protects FREE_MAP, FREE_MAP_DIRTY, and the counts above.  Held
+   only within this file and never across cache accesses, so that
+   callers may allocate and release sectors with or without
+   free_map_lock. */
+static struct lock map_lock;
+
+/* Recounts the free sectors in each group from the free map.  The
+   caller must hold map_lock, unless it is free_map_init(). */
+static void
+free_map_count_groups (void)
+{
+  size_t size = bitmap_size (free_map);
+  size_t g;
+
+  free_sectors = 0;
+  for (g = 0; g < group_cnt; g++)
+    {
+      size_t start = g * GROUP_SECTORS;
+      size_t cnt = size - start < GROUP_SECTORS ? size - start : GROUP_SECTORS;
+      group_free[g] = bitmap_count (free_map, start, cnt, false);
+      free_sectors += group_free[g];
+    }
+}
 
 /* Initializes the free map. */
 void
@@ -22,51 +65,340 @@ free_map_init (void)
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
 
+  group_cnt = DIV_ROUND_UP (bitmap_size (free_map), GROUP_SECTORS);
+  group_free = malloc (group_cnt * sizeof *group_free);
+  if (group_free == NULL)
+    PANIC ("allocation group creation failed");
+  free_map_count_groups ();
+
+  free_map_dirty = bitmap_create (DIV_ROUND_UP (bitmap_file_size (free_map),
+                                                BLOCK_SECTOR_SIZE));
+  if (free_map_dirty == NULL)
+    PANIC ("free map dirty bitmap creation failed");
+
   lock_init (&free_map_lock);
+  lock_set_name (&free_map_lock, "free map");
+  lock_init (&map_lock);
+  lock_set_name (&map_lock, "free map bits");
 }
 
-/* Allocates a sectors from the free map and stores it in *SECTORP.
-   Returns true if successful, false if no sector was available or if the
-   free_map file could not be written. */
-bool
-free_map_alloc (block_sector_t *sectorp)
+/* Marks the CNT sectors starting at SECTOR as in use, if USED is
+   true, or as free, and updates the group counts and the dirty
+   sectors of the free map file.  They must all be in the opposite
+   state.  The caller must hold map_lock. */
+static void
+free_map_set (block_sector_t sector, size_t cnt, bool used)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, 1, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  size_t i;
+
+  ASSERT (used ? bitmap_none (free_map, sector, cnt)
+          : bitmap_all (free_map, sector, cnt));
+  bitmap_set_multiple (free_map, sector, cnt, used);
+  if (used)
+    free_sectors -= cnt;
+  else
+    free_sectors += cnt;
+  for (i = 0; i < cnt; i++)
     {
-      bitmap_set_multiple (free_map, sector, 1, false);
-      sector = BITMAP_ERROR;
+      size_t g = (sector + i) / GROUP_SECTORS;
+      if (used)
+        group_free[g]--;
+      else
+        group_free[g]++;
     }
+  bitmap_set_multiple (free_map_dirty,
+                       sector / CHAR_BIT / BLOCK_SECTOR_SIZE,
+                       (sector + cnt - 1) / CHAR_BIT / BLOCK_SECTOR_SIZE
+                       - sector / CHAR_BIT / BLOCK_SECTOR_SIZE + 1, true);
+}
+
+/* Returns the first sector in [START, END) that begins a run of
+   CNT free sectors and, unless it is GOAL, follows a run of BEFORE
+   free sectors.  Returns BITMAP_ERROR if there is none.  The caller
+   must hold map_lock. */
+static size_t
+free_map_scan_range (size_t start, size_t end, size_t cnt, size_t before,
+                     block_sector_t goal)
+{
+  size_t size = bitmap_size (free_map);
+  size_t sector;
+
+  for (sector = start; sector < end && sector + cnt <= size; sector++)
+    if (!bitmap_test (free_map, sector)
+        && !bitmap_contains (free_map, sector, cnt, true)
+        && (before == 0 || sector == goal
+            || (sector >= before
+                && bitmap_none (free_map, sector - before, before))))
+      return sector;
+  return BITMAP_ERROR;
+}
+
+/* Returns the first sector that begins a run of CNT free sectors,
+   and that is GOAL or follows BEFORE free sectors, looking at GOAL
+   and after it in its group first, then in the
+   following groups in order, wrapping around, and skipping groups
+   with no free sectors.  Returns BITMAP_ERROR if there is no such
+   run, or if taking CNT sectors would eat into those set aside by
+   free_map_reserve().  The caller must hold map_lock. */
+static size_t
+free_map_scan (block_sector_t goal, size_t cnt, size_t before)
+{
+  size_t size = bitmap_size (free_map);
+  size_t first, k;
+
+  if (free_sectors < reserved_sectors + cnt)
+    return BITMAP_ERROR;
+  if (goal >= size)
+    goal = 0;
+  first = goal / GROUP_SECTORS;
+  for (k = 0; k <= group_cnt; k++)
+    {
+      size_t g = (first + k) % group_cnt;
+      size_t start = k == 0 ? goal : g * GROUP_SECTORS;
+      size_t end = k == group_cnt ? goal : (g + 1) * GROUP_SECTORS;
+      size_t sector;
+
+      if (group_free[g] == 0)
+        continue;
+      sector = free_map_scan_range (start, end, cnt, before, goal);
+      if (sector != BITMAP_ERROR)
+        return sector;
+    }
+  return BITMAP_ERROR;
+}
+
+/* Allocates CNT consecutive sectors from the free map, as close
+   after GOAL as possible, and stores the first into *SECTORP.
+   Returns true if successful, false if not enough consecutive
+   sectors were available. */
+bool
+free_map_alloc (block_sector_t goal, size_t cnt, block_sector_t *sectorp)
+{
+  size_t sector;
+
+  lock_acquire (&map_lock);
+  sector = free_map_scan (goal, cnt, 0);
   if (sector != BITMAP_ERROR)
-    *sectorp = sector;
-  return sector != BITMAP_ERROR;
+    free_map_set (sector, cnt, true);
+  lock_release (&map_lock);
+
+  if (sector == BITMAP_ERROR)
+    return false;
+  *sectorp = sector;
+  return true;
+}
+
+/* Allocates CNT consecutive sectors like free_map_alloc(), but out
+   of the sectors set aside by free_map_reserve(), of which the
+   caller must hold at least CNT.  On success, they are no longer
+   set aside.  Taking them and allocating them at once keeps other
+   allocations from using them up in between. */
+bool
+free_map_alloc_reserved (block_sector_t goal, size_t cnt,
+                         block_sector_t *sectorp)
+{
+  size_t sector;
+
+  lock_acquire (&map_lock);
+  ASSERT (reserved_sectors >= cnt);
+  reserved_sectors -= cnt;
+  sector = free_map_scan (goal, cnt, 0);
+  if (sector != BITMAP_ERROR)
+    free_map_set (sector, cnt, true);
+  else
+    reserved_sectors += cnt;
+  lock_release (&map_lock);
+
+  if (sector == BITMAP_ERROR)
+    return false;
+  *sectorp = sector;
+  return true;
+}
+
+/* Zero-fills the CNT sectors starting at SECTOR in the cache,
+   as holding CLASS. */
+static void
+free_map_zero (block_sector_t sector, size_t cnt, enum cache_class class)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    cache_write (fs_device, sector + i, class, zeros, 0, BLOCK_SECTOR_SIZE);
 }
 
-/* Allocates a sectors from the free map and stores it in *SECTORP.
-   On success, the newly created block will be zero-filled.
-   Returns true if successful, false if no sector was available or if the
-   free_map file could not be written. */
+/* Allocates CNT consecutive sectors like free_map_alloc().  On
+   success, the newly allocated sectors will be zero-filled, and
+   cached as holding CLASS. */
 bool
-free_map_calloc (block_sector_t *sectorp)
+free_map_calloc (block_sector_t goal, size_t cnt, block_sector_t *sectorp,
+                 enum cache_class class)
 {
-  if (free_map_alloc (sectorp))
+  if (!free_map_alloc (goal, cnt, sectorp))
+    return false;
+  free_map_zero (*sectorp, cnt, class);
+  return true;
+}
+
+/* Allocates CNT consecutive sectors out of those set aside, like
+   free_map_alloc_reserved(), and zero-fills and caches them like
+   free_map_calloc(). */
+bool
+free_map_calloc_reserved (block_sector_t goal, size_t cnt,
+                          block_sector_t *sectorp, enum cache_class class)
+{
+  if (!free_map_alloc_reserved (goal, cnt, sectorp))
+    return false;
+  free_map_zero (*sectorp, cnt, class);
+  return true;
+}
+
+/* Allocates one sector like free_map_calloc(), preferring the
+   first sector of a run of ROOM free sectors, so that the sectors
+   after it stay free for the caller to grow into.  Unless it is
+   GOAL, which follows the caller's own sectors, the sector should
+   also follow ROOM free sectors, so that the file whose sectors
+   come before it has room to grow too.  Two files that grow side
+   by side then take turns in runs of about ROOM sectors. */
+bool
+free_map_calloc_room (block_sector_t goal, size_t room,
+                      block_sector_t *sectorp, enum cache_class class)
+{
+  size_t sector;
+
+  lock_acquire (&map_lock);
+  sector = free_map_scan (goal, room, room);
+  if (sector == BITMAP_ERROR)
+    sector = free_map_scan (goal, room, 0);
+  if (sector == BITMAP_ERROR)
+    sector = free_map_scan (goal, 1, 0);
+  if (sector != BITMAP_ERROR)
+    free_map_set (sector, 1, true);
+  lock_release (&map_lock);
+
+  if (sector == BITMAP_ERROR)
+    return false;
+  free_map_zero (sector, 1, class);
+  *sectorp = sector;
+  return true;
+}
+
+/* Allocates SECTOR itself from the free map, if it is free, and
+   zero-fills and caches it like free_map_calloc().  Returns false
+   if SECTOR is in use or past the end of the device, or if every
+   free sector is set aside. */
+bool
+free_map_calloc_at (block_sector_t sector, enum cache_class class)
+{
+  bool success;
+
+  lock_acquire (&map_lock);
+  success = (sector < bitmap_size (free_map)
+             && !bitmap_test (free_map, sector)
+             && free_sectors > reserved_sectors);
+  if (success)
+    free_map_set (sector, 1, true);
+  lock_release (&map_lock);
+
+  if (success)
+    free_map_zero (sector, 1, class);
+  return success;
+}
+
+/* Makes the CNT sectors starting at SECTOR available for use. */
+void
+free_map_release (block_sector_t sector, size_t cnt)
+{
+  lock_acquire (&map_lock);
+  free_map_set (sector, cnt, false);
+  lock_release (&map_lock);
+}
+
+/* Sets aside CNT free sectors for blocks that will be allocated
+   later, so that other allocations cannot use them up.  Returns
+   false if there are not that many free sectors left that are not
+   already set aside. */
+bool
+free_map_reserve (size_t cnt)
+{
+  bool success;
+
+  lock_acquire (&map_lock);
+  success = free_sectors >= reserved_sectors + cnt;
+  if (success)
+    reserved_sectors += cnt;
+  lock_release (&map_lock);
+  return success;
+}
+
+/* Gives back CNT sectors set aside by free_map_reserve(), as just
+   before allocating them. */
+void
+free_map_unreserve (size_t cnt)
+{
+  lock_acquire (&map_lock);
+  ASSERT (reserved_sectors >= cnt);
+  reserved_sectors -= cnt;
+  lock_release (&map_lock);
+}
+
+/* Writes the sectors of the free map file whose part of the free
+   map changed since they were last written.  Called by the cache's
+   flusher thread and before the whole cache is written back. */
+void
+free_map_flush (void)
+{
+  size_t i;
+
+  if (free_map_file == NULL)
+    return;
+  for (i = 0; i < bitmap_size (free_map_dirty); i++)
     {
-      cache_write (fs_device, *sectorp, zeros, 0, BLOCK_SECTOR_SIZE);
-      return true;
+      bool dirty;
+
+      /* Clear the bit first, so that a change made while the
+         sector is written marks it again. */
+      lock_acquire (&map_lock);
+      dirty = bitmap_test (free_map_dirty, i);
+      bitmap_reset (free_map_dirty, i);
+      lock_release (&map_lock);
+      if (dirty
+          && !bitmap_write_part (free_map, free_map_file,
+                                 i * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE))
+        PANIC ("can't write free map");
     }
-  else
-    { return false; }
 }
 
-/* Makes SECTOR available for use. */
+/* Prints the free space in each allocation group, and how it is
+   broken up into runs of free sectors. */
 void
-free_map_release (block_sector_t sector)
+free_map_print_frag (void)
 {
-  ASSERT (bitmap_all (free_map, sector, 1));
-  bitmap_set_multiple (free_map, sector, 1, false);
-  bitmap_write (free_map, free_map_file);
+  size_t size = bitmap_size (free_map);
+  size_t free_cnt = 0, run_cnt = 0, largest = 0, run = 0;
+  size_t sector, g;
+
+  lock_acquire (&map_lock);
+  for (g = 0; g < group_cnt; g++)
+    {
+      size_t start = g * GROUP_SECTORS;
+      size_t cnt = size - start < GROUP_SECTORS ? size - start : GROUP_SECTORS;
+      printf ("Group %zu: %zu of %zu sectors free\n", g, group_free[g], cnt);
+      free_cnt += group_free[g];
+    }
+
+  for (sector = 0; sector <= size; sector++)
+    if (sector < size && !bitmap_test (free_map, sector))
+      run++;
+    else if (run > 0)
+      {
+        run_cnt++;
+        if (run > largest)
+          largest = run;
+        run = 0;
+      }
+  lock_release (&map_lock);
+  printf ("%zu of %zu sectors free in %zu runs, largest %zu sectors\n",
+          free_cnt, size, run_cnt, largest);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -78,13 +410,19 @@ free_map_open (void)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  lock_acquire (&map_lock);
+  free_map_count_groups ();
+  lock_release (&map_lock);
+  bitmap_set_all (free_map_dirty, false);
 }
 
 /* Writes the free map to disk and closes the free map file. */
 void
 free_map_close (void)
 {
+  free_map_flush ();
   file_close (free_map_file);
+  free_map_file = NULL;
 }
 
 /* Creates a new free map file on disk and writes the free map to
@@ -102,4 +440,5 @@ free_map_create (void)
     PANIC ("can't open free map");
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
+  bitmap_set_all (free_map_dirty, false);
 }
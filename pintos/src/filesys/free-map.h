@@ -4,8 +4,12 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include "devices/block.h"
+#include "filesys/cache.h"
 #include "threads/synch.h"
 
+/* Held across a series of allocations that must not interleave
+   with others, such as those that create an inode's blocks.  The
+   functions below lock the free map themselves. */
 struct lock free_map_lock;
 
 void free_map_init (void);
@@ -14,8 +18,20 @@ void free_map_create (void);
 void free_map_open (void);
 void free_map_close (void);
 
-bool free_map_alloc (block_sector_t *);
-bool free_map_calloc (block_sector_t *);
-void free_map_release (block_sector_t);
+bool free_map_alloc (block_sector_t goal, size_t cnt, block_sector_t *);
+bool free_map_alloc_reserved (block_sector_t goal, size_t cnt,
+                              block_sector_t *);
+bool free_map_calloc (block_sector_t goal, size_t cnt, block_sector_t *,
+                      enum cache_class);
+bool free_map_calloc_reserved (block_sector_t goal, size_t cnt,
+                               block_sector_t *, enum cache_class);
+bool free_map_calloc_room (block_sector_t goal, size_t room,
+                           block_sector_t *, enum cache_class);
+bool free_map_calloc_at (block_sector_t, enum cache_class);
+void free_map_release (block_sector_t, size_t cnt);
+bool free_map_reserve (size_t cnt);
+void free_map_unreserve (size_t cnt);
+void free_map_flush (void);
+void free_map_print_frag (void);
 
 #endif /* filesys/free-map.h */
@@ -7,6 +7,8 @@
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "filesys/inode.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
@@ -27,6 +29,36 @@ fsutil_ls (char **argv UNUSED)
   printf ("End of listing.\n");
 }
 
+/* Prints how the free space is broken up, and how many runs of
+   consecutive sectors hold each file in the root directory. */
+void
+fsutil_frag (char **argv UNUSED)
+{
+  struct dir *dir;
+  struct dir_entry entry;
+  char name[NAME_MAX + 1];
+
+  printf ("Fragmentation report:\n");
+  free_map_print_frag ();
+  dir = dir_open_root ();
+  if (dir == NULL)
+    PANIC ("root dir open failed");
+  while (dir_readdir (dir, name))
+    if (dir_lookup (dir, name, &entry))
+      {
+        struct inode *inode = inode_open (entry.inode_sector);
+        size_t sectors, frags;
+
+        if (inode == NULL)
+          PANIC ("%s: open failed", name);
+        frags = inode_fragments (inode, &sectors);
+        printf ("%s: %zu sectors in %zu fragments\n", name, sectors, frags);
+        inode_close (inode);
+      }
+  dir_close (dir);
+  printf ("End of report.\n");
+}
+
 /* Prints the contents of file ARGV[1] to the system console as
    hex and ASCII. */
 void
@@ -6,9 +6,11 @@
 #include <string.h>
 #include "devices/block.h"
 #include "filesys/cache.h"
+#include "filesys/extent.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
@@ -17,6 +19,15 @@
 #define INDIRECT_BLOCKS 128
 #define DBL_INDIRECT_BLOCKS (128 * 128)
 
+/* Bounds on the number of sectors read ahead of a sequential
+   reader. */
+#define READAHEAD_MIN 2
+#define READAHEAD_MAX 32
+
+/* Most inodes whose delayed blocks inode_flush_delayed() allocates
+   at a time. */
+#define DELAYED_FLUSH_BATCH 8
+
 /* On-disk inode.
    Must be exactly BLOCK_SECTOR_SIZE bytes long. */
 struct inode_disk
@@ -26,13 +37,53 @@ struct inode_disk
     block_sector_t indirect;            /* 64KiB from level 1 indirect pointer */
     block_sector_t dbl_indirect;        /* 8MiB from level 2 indirect pointer */
     unsigned magic;                     /* Magic number */
-    uint32_t unused[112];               /* Not used */
+    uint32_t flags;                     /* INODE_* flags. */
+    struct extent_root extents;         /* Extent tree, if INODE_EXTENTS. */
+    uint32_t unused[2];                 /* Not used */
   };
 
+/* Flags in struct inode_disk.  Inodes written before extents
+   existed have FLAGS zeroed, so they keep their block pointers. */
+#define INODE_EXTENTS 0x1               /* Mapped by EXTENTS, not by
+                                           DIRECT, INDIRECT, and
+                                           DBL_INDIRECT. */
+
 unsigned inode_magic = INODE_MAGIC;
 
-block_sector_t inode_create_sector (block_sector_t, off_t);
-void inode_free_sector (block_sector_t);
+/* Whether new inodes are mapped by extent trees. */
+static bool use_extents = true;
+
+/* Whether writes into holes of extent-mapped files put off
+   choosing sectors for their data. */
+static bool delay_alloc = false;
+
+/* A file block written but not yet given a sector.  Its data is
+   kept in the cache under KEY, a placeholder sector number, until
+   inode_allocate_delayed() moves it to a real sector. */
+struct delayed_block
+  {
+    struct list_elem elem;              /* Element in inode's list. */
+    size_t idx;                         /* Index of block in file. */
+    block_sector_t key;                 /* Placeholder sector. */
+  };
+
+/* Number of delayed blocks in all inodes, each with one free
+   sector reserved for it.  Protected by free_map_lock. */
+static size_t delayed_cnt;
+
+/* Free sectors reserved for the extent blocks that mapping delayed
+   blocks may need: this many for each delayed block, and
+   EXTENT_ADD_BLOCKS more for each inode that has any.  A split
+   extent block has room for half its entries, so mapping a run of
+   blocks needs well under two extent blocks for each on average,
+   even if every level must be split. */
+#define DELAYED_INDEX_SECTORS 2
+
+static char zeros[BLOCK_SECTOR_SIZE];
+
+block_sector_t inode_create_sector (block_sector_t, struct inode_disk *,
+                                    off_t);
+void inode_free_sector (block_sector_t, struct inode_disk *);
 
 bool inode_alloc_direct (block_sector_t, int);
 bool inode_alloc_indirect (block_sector_t, int);
@@ -55,122 +106,181 @@ struct inode
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
     struct lock lock;                   /* Lock for the metadata of the inode. */
+    struct rwlock rw;                   /* Shared for reads, exclusive for
+                                           writes and extension. */
+    enum cache_class data_class;        /* Cache class of its data. */
+    struct inode_disk data;             /* Copy of the on-disk inode,
+                                           protected by RW. */
+    struct list delayed;                /* Delayed blocks in order of
+                                           index, protected by RW. */
+    size_t index_reserve;               /* Sectors reserved for extent
+                                           blocks of delayed blocks,
+                                           protected by RW. */
   };
 
+/* Writes the SIZE bytes at OFS in DISK, the copy of the on-disk
+   inode in SECTOR, through to the cache. */
+static void
+inode_write_disk (block_sector_t sector, const struct inode_disk *disk,
+                  size_t ofs, size_t size)
+{
+  cache_write (fs_device, sector, CACHE_INODE, (const char *) disk + ofs,
+               ofs, size);
+}
+
+/* Reads the block pointer at index IDX of the pointer array that
+   starts OFS bytes into SECTOR, of cache class CLASS.  Uncounted
+   in the cache hit rate if PEEK is true. */
+static block_sector_t
+inode_read_ptr (block_sector_t sector, enum cache_class class, size_t ofs,
+                size_t idx, bool peek)
+{
+  block_sector_t ptr;
+
+  ofs += idx * sizeof (block_sector_t);
+  if (peek)
+    cache_peek (fs_device, sector, class, &ptr, ofs, sizeof ptr);
+  else
+    cache_read (fs_device, sector, class, &ptr, ofs, sizeof ptr);
+  return ptr;
+}
+
+/* Returns INODE's delayed block with index IDX, or a null pointer
+   if there is none.  The caller must hold INODE->RW. */
+static struct delayed_block *
+inode_find_delayed (struct inode *inode, size_t idx)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&inode->delayed); e != list_end (&inode->delayed);
+       e = list_next (e))
+    {
+      struct delayed_block *d = list_entry (e, struct delayed_block, elem);
+      if (d->idx >= idx)
+        return d->idx == idx ? d : NULL;
+    }
+  return NULL;
+}
+
 /* Returns the block device sector that contains byte offset POS
-   within INODE.
+   within INODE, whose RW the caller holds, or the placeholder
+   sector of a delayed block.
    Returns 0 if INODE does not contain data for a byte at offset
-   POS. */
+   POS.  Lookups made for read-ahead pass PEEK as true so that they
+   do not skew the cache statistics. */
 static block_sector_t
-inode_get_sector (const block_sector_t inode_sector, const off_t pos)
+inode_get_sector (struct inode *inode, const off_t pos, bool peek)
 {
   size_t idx = pos / BLOCK_SECTOR_SIZE;
   block_sector_t sector = 0;
 
-  if (idx < DIRECT_BLOCKS)
+  if (inode->data.flags & INODE_EXTENTS)
     {
-      cache_read (fs_device, inode_sector, &sector,
-                  offsetof (struct inode_disk, direct)
-                    + idx * sizeof (block_sector_t),
-                  sizeof (block_sector_t));
+      struct delayed_block *d = inode_find_delayed (inode, idx);
+      if (d != NULL)
+        return d->key;
+      return extent_lookup (&inode->data.extents, idx, peek);
     }
+
+  if (idx < DIRECT_BLOCKS)
+    sector = inode->data.direct[idx];
   else if (idx < DIRECT_BLOCKS + INDIRECT_BLOCKS)
     {
-      cache_read (fs_device, inode_sector, &sector,
-                  offsetof (struct inode_disk, indirect),
-                  sizeof (block_sector_t));
-      cache_read (fs_device, sector, &sector,
-                  (idx - DIRECT_BLOCKS) * sizeof (block_sector_t),
-                  sizeof (block_sector_t));
+      sector = inode->data.indirect;
+      if (sector)
+        sector = inode_read_ptr (sector, CACHE_INDEX, 0, idx - DIRECT_BLOCKS,
+                                 peek);
     }
   else if (idx < DIRECT_BLOCKS + INDIRECT_BLOCKS + DBL_INDIRECT_BLOCKS)
     {
-      cache_read (fs_device, inode_sector, &sector,
-                  offsetof (
-      struct inode_disk, indirect),
-      sizeof (block_sector_t));
+      sector = inode->data.dbl_indirect;
 
       int dbl_num = (idx - DIRECT_BLOCKS - INDIRECT_BLOCKS)
                     / INDIRECT_BLOCKS;
-      cache_read (fs_device, sector, &sector,
-                  dbl_num * sizeof (block_sector_t),
-                  sizeof (block_sector_t));
+      if (sector)
+        sector = inode_read_ptr (sector, CACHE_INDEX, 0, dbl_num, peek);
 
       int dbl_offset = (idx - DIRECT_BLOCKS - INDIRECT_BLOCKS)
                        % INDIRECT_BLOCKS;
-      cache_read (fs_device, sector, &sector,
-                  dbl_offset * sizeof (block_sector_t),
-                  sizeof (block_sector_t));
+      if (sector)
+        sector = inode_read_ptr (sector, CACHE_INDEX, 0, dbl_offset, peek);
     }
 
   return sector;
 }
 
 /* Returns the block device sector that contains byte offset POS
-   within INODE.
-   Allocates a new block if INODE does not contain data for a byte
-   at offset POS, and the newly allocated block will be zero-filled.
+   within the inode in INODE_SECTOR, whose contents are DISK.
+   Allocates a new block if the inode does not contain data for a
+   byte at offset POS, and the newly allocated block will be
+   zero-filled.  Pointers allocated in the inode itself are stored
+   in DISK and written through to the cache.
    Returns 0 if allocation fails. */
 block_sector_t
-inode_create_sector (const block_sector_t inode_sector, const off_t pos)
+inode_create_sector (block_sector_t inode_sector, struct inode_disk *disk,
+                     const off_t pos)
 {
   size_t idx = pos / BLOCK_SECTOR_SIZE;
 
-  block_sector_t sector, indirect, dbl_indirect;
+  block_sector_t sector, indirect;
 
-  if (idx < DIRECT_BLOCKS)
+  if (disk->flags & INODE_EXTENTS)
     {
-      /* Read DISK_INODE->DIRECT[IDX] into SECTOR. */
-      cache_read (fs_device, inode_sector, &sector,
-                  offsetof (struct inode_disk, direct)
-                    + idx * sizeof (block_sector_t),
-                  sizeof (block_sector_t));
+      bool root_changed;
+
+      sector = extent_create (&disk->extents, idx, inode_sector,
+                              &root_changed);
+      if (root_changed)
+        inode_write_disk (inode_sector, disk,
+                          offsetof (struct inode_disk, extents),
+                          sizeof disk->extents);
+      return sector;
+    }
 
-      /* If SECTOR == 0, then try to allocate a new block.
-       * If success, write back to DISK_INODE; otherwise, SECTOR will still be 0.  */
-      if (!sector)
+  if (idx < DIRECT_BLOCKS)
+    {
+      /* If DISK->DIRECT[IDX] == 0, then try to allocate a new block.
+       * If success, write back to DISK_INODE; otherwise fail.  */
+      if (!disk->direct[idx])
         {
-          if (free_map_calloc (&sector))
-            cache_write (fs_device, inode_sector, &sector,
-                         offsetof (struct inode_disk, direct)
-                           + idx * sizeof (block_sector_t),
-                         sizeof (block_sector_t));
+          if (free_map_calloc (inode_sector, 1, &disk->direct[idx],
+                               CACHE_DATA))
+            inode_write_disk (inode_sector, disk,
+                              offsetof (struct inode_disk, direct)
+                                + idx * sizeof (block_sector_t),
+                              sizeof (block_sector_t));
           else
             return 0;
         }
 
-      return sector;
+      return disk->direct[idx];
     }
   else if (idx < DIRECT_BLOCKS + INDIRECT_BLOCKS)
     {
-      /* Read DISK_INODE->INDIRECT into INDIRECT */
-      cache_read (fs_device, inode_sector, &indirect,
-                  offsetof (struct inode_disk, indirect),
-                  sizeof (block_sector_t));
-
-      /* If INDIRECT == 0, then try to allocate a new block.
+      /* If DISK->INDIRECT == 0, then try to allocate a new block.
        * If success, write back to DISK_INODE; otherwise fail.  */
-      if (!indirect)
+      if (!disk->indirect)
         {
-          if (free_map_calloc (&indirect))
-            cache_write (fs_device, inode_sector, &indirect,
-                         offsetof (struct inode_disk, indirect),
-                         sizeof (block_sector_t));
+          if (free_map_calloc (inode_sector, 1, &disk->indirect, CACHE_INDEX))
+            inode_write_disk (inode_sector, disk,
+                              offsetof (struct inode_disk, indirect),
+                              sizeof (block_sector_t));
           else
             return 0;
         }
+      indirect = disk->indirect;
 
       /* Read the correct pointer into SECTOR. */
       idx -= DIRECT_BLOCKS;
-      cache_read (fs_device, indirect, &sector,
+      cache_read (fs_device, indirect, CACHE_INDEX, &sector,
                   idx * sizeof (block_sector_t), sizeof (block_sector_t));
 
       /* If SECTOR == 0, then try to allocate a new block into SECTOR.
        * If success, write back to BLOCK_SECTOR; otherwise, SECTOR will still be 0.  */
       if (!sector)
         {
-          if (free_map_calloc (&sector))
-            cache_write (fs_device, indirect, &sector,
+          if (free_map_calloc (inode_sector, 1, &sector, CACHE_DATA))
+            cache_write (fs_device, indirect, CACHE_INDEX, &sector,
                          idx * sizeof (block_sector_t),
                          sizeof (block_sector_t));
           else
@@ -181,26 +291,23 @@ inode_create_sector (const block_sector_t inode_sector, const off_t pos)
     }
   else if (idx < DIRECT_BLOCKS + INDIRECT_BLOCKS + DBL_INDIRECT_BLOCKS)
     {
-      /* Read DISK_INODE->DBL_INDIRECT into DBL_INDIRECT */
-      cache_read (fs_device, inode_sector, &dbl_indirect,
-                  offsetof (struct inode_disk, dbl_indirect),
-                  sizeof (block_sector_t));
-
-      /* If BLOCK_SECTOR == 0, then try to allocate a new block into
-       * BLOCK_SECTOR. If success, write back to DISK_INODE.  */
-      if (!dbl_indirect)
+      /* If DISK->DBL_INDIRECT == 0, then try to allocate a new block.
+       * If success, write back to DISK_INODE; otherwise fail.  */
+      if (!disk->dbl_indirect)
         {
-          if (free_map_calloc (&dbl_indirect))
-            cache_write (fs_device, inode_sector, &dbl_indirect,
-                         offsetof (struct inode_disk, dbl_indirect),
-                         sizeof (block_sector_t));
+          if (free_map_calloc (inode_sector, 1, &disk->dbl_indirect,
+                               CACHE_INDEX))
+            inode_write_disk (inode_sector, disk,
+                              offsetof (struct inode_disk, dbl_indirect),
+                              sizeof (block_sector_t));
           else
             return 0;
         }
+      block_sector_t dbl_indirect = disk->dbl_indirect;
 
       /* Read the correct indirect pointer into INDIRECT. */
       idx -= DIRECT_BLOCKS + INDIRECT_BLOCKS;
-      cache_read (fs_device, dbl_indirect, &indirect,
+      cache_read (fs_device, dbl_indirect, CACHE_INDEX, &indirect,
                   (idx / INDIRECT_BLOCKS) * sizeof (block_sector_t),
                   sizeof (block_sector_t));
 
@@ -209,8 +316,8 @@ inode_create_sector (const block_sector_t inode_sector, const off_t pos)
        * be 0.  */
       if (!indirect)
         {
-          if (free_map_calloc (&indirect))
-            cache_write (fs_device, dbl_indirect, &indirect,
+          if (free_map_calloc (inode_sector, 1, &indirect, CACHE_INDEX))
+            cache_write (fs_device, dbl_indirect, CACHE_INDEX, &indirect,
                          (idx / INDIRECT_BLOCKS) * sizeof (block_sector_t),
                          sizeof (block_sector_t));
           else
@@ -218,7 +325,7 @@ inode_create_sector (const block_sector_t inode_sector, const off_t pos)
         }
 
       /* Read the correct pointer into SECTOR. */
-      cache_read (fs_device, indirect, &sector,
+      cache_read (fs_device, indirect, CACHE_INDEX, &sector,
                   (idx % INDIRECT_BLOCKS) * sizeof (block_sector_t),
                   sizeof (block_sector_t));
 
@@ -227,8 +334,8 @@ inode_create_sector (const block_sector_t inode_sector, const off_t pos)
        * be 0.  */
       if (!sector)
         {
-          if (free_map_calloc (&sector))
-            cache_write (fs_device, indirect, &sector,
+          if (free_map_calloc (inode_sector, 1, &sector, CACHE_DATA))
+            cache_write (fs_device, indirect, CACHE_INDEX, &sector,
                          (idx % INDIRECT_BLOCKS) * sizeof (block_sector_t),
                          sizeof (block_sector_t));
           else
@@ -241,84 +348,83 @@ inode_create_sector (const block_sector_t inode_sector, const off_t pos)
     { return 0; }
 }
 
-/* Free the allocated pointers in the STRUCT INODE_DISK correspoinding to
- * SECTOR. The STRUCT INODE_DISK itself will NOT be freed.
+/* Free the allocated pointers in DISK, the contents of the inode
+ * in INODE_SECTOR, and clears them in DISK and on disk.  The
+ * STRUCT INODE_DISK itself will NOT be freed.
  */
-void inode_free_sector (block_sector_t inode_sector)
+void inode_free_sector (block_sector_t inode_sector, struct inode_disk *disk)
 {
   lock_acquire (&free_map_lock);
 
   int i, j;
-  block_sector_t sector, indirect, dbl_indirect;
+  block_sector_t sector, indirect;
 
-  /* Free direct pointers. */
-  for (i = 0; i < DIRECT_BLOCKS; ++i)
+  if (disk->flags & INODE_EXTENTS)
     {
-      cache_read (fs_device, inode_sector, &sector,
-                  offsetof (struct inode_disk, direct)
-      + i * sizeof (block_sector_t),
-        sizeof (block_sector_t));
-      if (sector)
-        free_map_release (sector);
-
-      sector = NULL;
-      cache_write (fs_device, inode_sector, &sector,
-                   offsetof (struct inode_disk, direct)
-      + i * sizeof (block_sector_t),
-        sizeof (block_sector_t));
+      extent_free (&disk->extents);
+      inode_write_disk (inode_sector, disk, 0, sizeof *disk);
+      lock_release (&free_map_lock);
+      return;
     }
 
+  /* Free direct pointers. */
+  for (i = 0; i < DIRECT_BLOCKS; ++i)
+    if (disk->direct[i])
+      {
+        free_map_release (disk->direct[i], 1);
+        disk->direct[i] = 0;
+      }
+
   /* Free indirect pointers. */
-  cache_read (fs_device, inode_sector, &indirect,
-              offsetof (struct inode_disk, indirect), sizeof (block_sector_t));
-  if (indirect)
+  if (disk->indirect)
     {
       for (i = 0; i < INDIRECT_BLOCKS; ++i)
         {
-          cache_read (fs_device, indirect, &sector,
+          cache_read (fs_device, disk->indirect, CACHE_INDEX, &sector,
                       i * sizeof (block_sector_t), sizeof (block_sector_t));
 
           if (sector)
-            free_map_release (sector);
+            free_map_release (sector, 1);
 
-          sector = NULL;
-          cache_write (fs_device, indirect, &sector,
+          sector = 0;
+          cache_write (fs_device, disk->indirect, CACHE_INDEX, &sector,
                       i * sizeof (block_sector_t), sizeof (block_sector_t));
         }
-      free_map_release (indirect);
+      free_map_release (disk->indirect, 1);
+      disk->indirect = 0;
     }
 
   /* Free double indirect pointers. */
-  cache_read (fs_device, inode_sector, &dbl_indirect,
-              offsetof (struct inode_disk, dbl_indirect),
-  sizeof (block_sector_t));
-  if (dbl_indirect)
+  if (disk->dbl_indirect)
     {
       for (j = 0; j < INDIRECT_BLOCKS; ++j)
         {
-          cache_read (fs_device, dbl_indirect, &indirect,
-                      i * sizeof (block_sector_t), sizeof (block_sector_t));
+          cache_read (fs_device, disk->dbl_indirect, CACHE_INDEX, &indirect,
+                      j * sizeof (block_sector_t), sizeof (block_sector_t));
           if (indirect)
             {
               for (i = 0; i < INDIRECT_BLOCKS; ++i)
                 {
-                  cache_read (fs_device, indirect, &sector,
+                  cache_read (fs_device, indirect, CACHE_INDEX, &sector,
                               i * sizeof (block_sector_t),
                               sizeof (block_sector_t));
                   if (sector)
-                    free_map_release (sector);
+                    free_map_release (sector, 1);
 
-                  sector = NULL;
-                  cache_write (fs_device, indirect, &sector,
+                  sector = 0;
+                  cache_write (fs_device, indirect, CACHE_INDEX, &sector,
                               i * sizeof (block_sector_t),
                               sizeof (block_sector_t));
                 }
-              free_map_release (indirect);
+              free_map_release (indirect, 1);
             }
         }
-      free_map_release (dbl_indirect);
+      free_map_release (disk->dbl_indirect, 1);
+      disk->dbl_indirect = 0;
     }
 
+  inode_write_disk (inode_sector, disk, 0, sizeof *disk);
+
   lock_release (&free_map_lock);
 }
 
@@ -334,6 +440,26 @@ inode_init (void)
 {
   list_init (&open_inodes);
   lock_init (&open_inodes_lock);
+  lock_set_name (&open_inodes_lock, "open inodes");
+}
+
+/* Sets whether writes into holes of extent-mapped files, such as
+   appends, keep their data in the cache without choosing sectors
+   for it, if DELAY is true, so that the sectors can be allocated
+   later in runs, or allocate each sector as it is written. */
+void
+inode_delay_alloc (bool delay)
+{
+  delay_alloc = delay;
+}
+
+/* Sets whether inodes created from now on map their data through
+   extent trees, if EXTENTS is true, or through block pointers, the
+   format from before extents existed.  Either kind can be read. */
+void
+inode_use_extents (bool extents)
+{
+  use_extents = extents;
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -351,26 +477,42 @@ inode_create (block_sector_t sector, off_t length)
   ASSERT (sizeof (struct inode_disk) == BLOCK_SECTOR_SIZE);
 
   size_t sectors = bytes_to_sectors (length);
+  struct inode_disk *disk_inode = calloc (1, sizeof *disk_inode);
+  if (disk_inode == NULL)
+    return false;
+
+  /* Write the whole inode at once, so that its sector need not be
+     read first. */
+  disk_inode->length = length;
+  disk_inode->magic = inode_magic;
+  if (use_extents)
+    disk_inode->flags = INODE_EXTENTS;
+  inode_write_disk (sector, disk_inode, 0, sizeof *disk_inode);
 
   lock_acquire (&free_map_lock);
 
+  /* Lay an extent-mapped file out in one run if there is room. */
+  if ((disk_inode->flags & INODE_EXTENTS) && sectors > 0
+      && extent_prealloc (&disk_inode->extents, sectors, sector))
+    {
+      inode_write_disk (sector, disk_inode,
+                        offsetof (struct inode_disk, extents),
+                        sizeof disk_inode->extents);
+      sectors = 0;
+    }
+
   size_t i;
   for (i = 0; i < sectors; ++i)
-    if (!inode_create_sector (sector, i))
+    if (!inode_create_sector (sector, disk_inode, i))
       {
         lock_release (&free_map_lock);
-        inode_free_sector (sector);
+        inode_free_sector (sector, disk_inode);
+        free (disk_inode);
         return false;
       }
 
   lock_release (&free_map_lock);
-
-  /* Save metadata to DISK_INODE. */
-
-  cache_write (fs_device, sector, &length,
-               offsetof (struct inode_disk, length), sizeof (off_t));
-  cache_write (fs_device, sector, &inode_magic,
-               offsetof (struct inode_disk, magic), sizeof (unsigned));
+  free (disk_inode);
 
   return true;
 }
@@ -413,7 +555,14 @@ inode_open (block_sector_t sector)
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
+  inode->data_class = CACHE_DATA;
+  list_init (&inode->delayed);
+  inode->index_reserve = 0;
   lock_init (&inode->lock);
+  lock_set_name (&inode->lock, "inode");
+  rwlock_init (&inode->rw);
+  cache_read (fs_device, sector, CACHE_INODE, &inode->data, 0,
+              BLOCK_SECTOR_SIZE);
 
   lock_release (&open_inodes_lock);
 
@@ -431,6 +580,240 @@ inode_reopen (struct inode *inode)
   return inode;
 }
 
+/* Gives back the sectors reserved for INODE's extent blocks once
+   it has no delayed blocks left.  The caller must hold INODE->RW
+   for writing, and free_map_lock. */
+static void
+inode_trim_reserve (struct inode *inode)
+{
+  if (list_empty (&inode->delayed))
+    {
+      free_map_unreserve (inode->index_reserve);
+      inode->index_reserve = 0;
+    }
+}
+
+/* Gives each of INODE's delayed blocks a sector, allocating runs
+   of consecutive sectors for runs of consecutive blocks, right
+   after the file's preceding block where possible, and moves the
+   blocks' data from their placeholders.  Extent blocks come out of
+   INODE's reserve, so running out of disk cannot stop this.  The
+   data was already accepted by a write, so failing to map a block
+   anyway, because memory or the extent tree ran out, is a kernel
+   panic rather than silent data loss.  The caller must hold
+   INODE->RW for writing. */
+static void
+inode_allocate_delayed (struct inode *inode)
+{
+  bool root_changed = false;
+
+  lock_acquire (&free_map_lock);
+  while (!list_empty (&inode->delayed))
+    {
+      struct list_elem *e = list_front (&inode->delayed);
+      struct delayed_block *d = list_entry (e, struct delayed_block, elem);
+      size_t idx = d->idx;
+      block_sector_t goal = 0, start;
+      size_t cnt, i;
+
+      /* Count the run of consecutive blocks at the front. */
+      for (cnt = 1; list_next (e) != list_end (&inode->delayed); cnt++)
+        {
+          e = list_next (e);
+          if (list_entry (e, struct delayed_block, elem)->idx != idx + cnt)
+            break;
+        }
+
+      if (idx > 0)
+        goal = extent_lookup (&inode->data.extents, idx - 1, true);
+      goal = goal != 0 ? goal + 1 : inode->sector;
+
+      /* Sectors were reserved for the blocks, so a single sector is
+         always free, but a whole run may not be. */
+      while (!free_map_alloc_reserved (goal, cnt, &start))
+        {
+          if (cnt == 1)
+            PANIC ("no free sector for delayed block");
+          cnt /= 2;
+        }
+
+      for (i = 0; i < cnt; i++)
+        {
+          bool changed = false;
+
+          d = list_entry (list_pop_front (&inode->delayed),
+                          struct delayed_block, elem);
+          if (!extent_set (&inode->data.extents, d->idx, start + i,
+                           inode->sector, &inode->index_reserve, &changed))
+            PANIC ("cannot map delayed block");
+          cache_move (fs_device, d->key, start + i, inode->data_class);
+          root_changed = root_changed || changed;
+          free (d);
+          delayed_cnt--;
+        }
+    }
+  inode_trim_reserve (inode);
+  lock_release (&free_map_lock);
+
+  if (root_changed)
+    inode_write_disk (inode->sector, &inode->data,
+                      offsetof (struct inode_disk, extents),
+                      sizeof inode->data.extents);
+}
+
+/* Drops INODE's delayed blocks without writing them anywhere, as
+   for an inode removed before they were allocated. */
+static void
+inode_discard_delayed (struct inode *inode)
+{
+  lock_acquire (&free_map_lock);
+  while (!list_empty (&inode->delayed))
+    {
+      struct delayed_block *d = list_entry (list_pop_front (&inode->delayed),
+                                            struct delayed_block, elem);
+      cache_discard (d->key);
+      free_map_unreserve (1);
+      free (d);
+      delayed_cnt--;
+    }
+  inode_trim_reserve (inode);
+  lock_release (&free_map_lock);
+}
+
+/* Reserves a free sector for one more delayed block of INODE, and
+   the sectors its extent blocks may need.  Returns false if there
+   are not enough, or if the cache already holds as many delayed
+   blocks as it can spare.  The caller must hold INODE->RW for
+   writing. */
+static bool
+inode_reserve_delayed (struct inode *inode)
+{
+  size_t index_cnt = DELAYED_INDEX_SECTORS;
+  bool success;
+
+  if (list_empty (&inode->delayed))
+    index_cnt += EXTENT_ADD_BLOCKS;
+  lock_acquire (&free_map_lock);
+  success = (delayed_cnt < cache_delayed_limit ()
+             && free_map_reserve (1 + index_cnt));
+  if (success)
+    {
+      delayed_cnt++;
+      inode->index_reserve += index_cnt;
+    }
+  lock_release (&free_map_lock);
+  return success;
+}
+
+/* Makes block IDX of INODE, which is in a hole, a zero-filled
+   delayed block, and returns its placeholder sector.  If no more
+   blocks can be delayed, even after allocating INODE's own,
+   allocates a sector for the block right away instead.  Returns 0
+   if that fails.  The caller must hold INODE->RW for writing. */
+static block_sector_t
+inode_delay_block (struct inode *inode, size_t idx)
+{
+  struct delayed_block *d;
+  struct list_elem *e;
+
+  if (!inode_reserve_delayed (inode))
+    {
+      if (!list_empty (&inode->delayed))
+        inode_allocate_delayed (inode);
+      if (!inode_reserve_delayed (inode))
+        return inode_create_sector (inode->sector, &inode->data,
+                                    idx * BLOCK_SECTOR_SIZE);
+    }
+
+  d = malloc (sizeof *d);
+  if (d == NULL)
+    {
+      lock_acquire (&free_map_lock);
+      free_map_unreserve (1 + DELAYED_INDEX_SECTORS);
+      inode->index_reserve -= DELAYED_INDEX_SECTORS;
+      delayed_cnt--;
+      inode_trim_reserve (inode);
+      lock_release (&free_map_lock);
+      return 0;
+    }
+  d->idx = idx;
+  d->key = cache_delayed_sector ();
+  cache_write (fs_device, d->key, inode->data_class, zeros, 0,
+               BLOCK_SECTOR_SIZE);
+
+  for (e = list_begin (&inode->delayed); e != list_end (&inode->delayed);
+       e = list_next (e))
+    if (list_entry (e, struct delayed_block, elem)->idx > idx)
+      break;
+  list_insert (e, &d->elem);
+  return d->key;
+}
+
+/* Returns the sector to write byte offset POS of INODE into,
+   which may be the placeholder of a delayed block, making one if
+   POS is in a hole.  Returns 0 if allocation fails.  The caller
+   must hold INODE->RW for writing. */
+static block_sector_t
+inode_write_sector (struct inode *inode, off_t pos)
+{
+  block_sector_t sector;
+
+  if (!delay_alloc || !(inode->data.flags & INODE_EXTENTS))
+    return inode_create_sector (inode->sector, &inode->data, pos);
+
+  sector = inode_get_sector (inode, pos, false);
+  if (sector == 0)
+    sector = inode_delay_block (inode, pos / BLOCK_SECTOR_SIZE);
+  return sector;
+}
+
+/* Allocates sectors for the delayed blocks of open inodes, so that
+   their data can be written back.  Called by the cache's flusher
+   thread and before the whole cache is written back. */
+void
+inode_flush_delayed (void)
+{
+  struct inode *batch[DELAYED_FLUSH_BATCH];
+  size_t cnt, i;
+
+  do
+    {
+      struct list_elem *e;
+
+      /* Hold each inode open, so that it cannot be freed once
+         OPEN_INODES_LOCK is released.  An inode whose last opener
+         is closing it allocates its own delayed blocks. */
+      cnt = 0;
+      lock_acquire (&open_inodes_lock);
+      for (e = list_begin (&open_inodes);
+           e != list_end (&open_inodes) && cnt < DELAYED_FLUSH_BATCH;
+           e = list_next (e))
+        {
+          struct inode *inode = list_entry (e, struct inode, elem);
+
+          if (list_empty (&inode->delayed))
+            continue;
+          lock_acquire (&inode->lock);
+          if (inode->open_cnt > 0)
+            {
+              inode->open_cnt++;
+              batch[cnt++] = inode;
+            }
+          lock_release (&inode->lock);
+        }
+      lock_release (&open_inodes_lock);
+
+      for (i = 0; i < cnt; i++)
+        {
+          rwlock_acquire_write (&batch[i]->rw);
+          inode_allocate_delayed (batch[i]);
+          rwlock_release_write (&batch[i]->rw);
+          inode_close (batch[i]);
+        }
+    }
+  while (cnt == DELAYED_FLUSH_BATCH);
+}
+
 /* Returns INODE's inode number. */
 block_sector_t
 inode_get_inumber (const struct inode *inode)
@@ -448,23 +831,33 @@ inode_close (struct inode *inode)
   if (inode == NULL)
     return;
 
+  /* Drop the reference under OPEN_INODES_LOCK, so that
+     inode_open() cannot find and reopen the inode between its
+     last close and its removal from the list. */
+  lock_acquire (&open_inodes_lock);
   lock_acquire (&inode->lock);
   int open_cnt = --inode->open_cnt;
   lock_release (&inode->lock);
+  if (open_cnt == 0)
+    list_remove (&inode->elem);
+  lock_release (&open_inodes_lock);
 
   /* Release resources if this was the last opener. */
   if (open_cnt == 0)
     {
-      /* Remove from inode list and release lock. */
-      lock_acquire (&open_inodes_lock);
-      list_remove (&inode->elem);
-      lock_release (&open_inodes_lock);
-
-      /* Deallocate blocks if removed. */
+      /* Deallocate blocks if removed.  Otherwise, give delayed
+         blocks their sectors now that the file is done with. */
       if (inode->removed)
         {
-          inode_free_sector (inode->sector);
-          free_map_release (inode->sector);
+          inode_discard_delayed (inode);
+          inode_free_sector (inode->sector, &inode->data);
+          free_map_release (inode->sector, 1);
+        }
+      else if (!list_empty (&inode->delayed))
+        {
+          rwlock_acquire_write (&inode->rw);
+          inode_allocate_delayed (inode);
+          rwlock_release_write (&inode->rw);
         }
 
       free (inode);
@@ -482,27 +875,34 @@ inode_remove (struct inode *inode)
   lock_release (&inode->lock);
 }
 
+/* Returns the length of INODE's data as recorded on disk.  The
+   caller must hold INODE->RW. */
+static off_t
+inode_disk_length (const struct inode *inode)
+{
+  return inode->data.length;
+}
+
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
    Returns the number of bytes actually read, which may be less
-   than SIZE if an error occurs or end of file is reached. If a block
-   is within the length but not initialized, it will be initialized here
-   before reading since sparse file is supported. */
+   than SIZE if an error occurs or end of file is reached. A block
+   within the length that has not been allocated yet, since sparse
+   files are supported, reads as zeros.  Any number of readers may
+   run at once. */
 off_t
 inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
 
-  lock_acquire (&inode->lock);
+  rwlock_acquire_read (&inode->rw);
 
   while (size > 0)
     {
       /* Bytes left in inode. */
-      off_t inode_left = inode_length (inode) - offset;
-      /* Disk sector to read, create if within length and not initialized. */
-      block_sector_t sector_idx = inode_left > 0
-                                  ? inode_create_sector (inode->sector, offset)
-                                  : inode_get_sector (inode->sector, offset);
+      off_t inode_left = inode_disk_length (inode) - offset;
+      /* Disk sector to read, or 0 for a hole. */
+      block_sector_t sector_idx = inode_get_sector (inode, offset, false);
       /* Starting byte offset within sector. */
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
@@ -515,7 +915,35 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      cache_read (fs_device, sector_idx, buffer + bytes_read, sector_ofs, chunk_size);
+      /* Take in the following sectors of the file as long as they
+         also follow on disk within the same cache block, so that
+         they are copied out in one cache access. */
+      if (sector_idx != 0)
+        for (;;)
+          {
+            block_sector_t next = sector_idx
+                                  + (sector_ofs + chunk_size)
+                                    / BLOCK_SECTOR_SIZE;
+            int more = inode_left - chunk_size;
+
+            if (chunk_size == size || chunk_size == inode_left
+                || (sector_ofs + chunk_size) % BLOCK_SECTOR_SIZE != 0
+                || next % cache_block_sectors () == 0
+                || inode_get_sector (inode, offset + chunk_size,
+                                     false) != next)
+              break;
+            if (more > size - chunk_size)
+              more = size - chunk_size;
+            if (more > BLOCK_SECTOR_SIZE)
+              more = BLOCK_SECTOR_SIZE;
+            chunk_size += more;
+          }
+
+      if (sector_idx != 0)
+        cache_read (fs_device, sector_idx, inode->data_class,
+                    buffer + bytes_read, sector_ofs, chunk_size);
+      else
+        memset (buffer + bytes_read, 0, chunk_size);
 
       /* Advance. */
       size -= chunk_size;
@@ -523,17 +951,81 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       bytes_read += chunk_size;
     }
 
-  lock_release (&inode->lock);
+  rwlock_release_read (&inode->rw);
 
   return bytes_read;
 }
 
+/* Initializes RA for a file that has not been read yet. */
+void
+inode_readahead_init (struct readahead *ra)
+{
+  ra->next = 0;
+  ra->ahead = 0;
+  ra->window = 0;
+}
+
+/* Notes that SIZE bytes were just read from INODE at OFFSET through
+   the file that owns RA.  If reads through it have been sequential,
+   queues the sectors that the next reads will want for loading by
+   the cache's readahead thread, doubling the number read ahead
+   with each sequential read up to READAHEAD_MAX sectors.  Returns
+   without waiting for the sectors to load. */
+void
+inode_readahead (struct inode *inode, struct readahead *ra, off_t offset,
+                 off_t size)
+{
+  if (size <= 0)
+    return;
+
+  if (offset != ra->next)
+    {
+      /* Random access: start over. */
+      ra->window = 0;
+      ra->ahead = 0;
+    }
+  else if (ra->window == 0)
+    ra->window = READAHEAD_MIN;
+  else if (ra->window < READAHEAD_MAX)
+    ra->window *= 2;
+  ra->next = offset + size;
+
+  if (ra->window == 0)
+    return;
+
+  rwlock_acquire_read (&inode->rw);
+
+  off_t length = inode_disk_length (inode);
+
+  /* Sectors already queued need not be queued again. */
+  off_t start = ROUND_UP (ra->next, BLOCK_SECTOR_SIZE);
+  if (start < ra->ahead)
+    start = ra->ahead;
+  off_t end = ROUND_UP (ra->next, BLOCK_SECTOR_SIZE)
+        + ra->window * BLOCK_SECTOR_SIZE;
+  if (end > length)
+    end = length;
+
+  off_t pos;
+  for (pos = start; pos < end; pos += BLOCK_SECTOR_SIZE)
+    {
+      block_sector_t sector = inode_get_sector (inode, pos, true);
+      if (sector != 0)
+        cache_prefetch (fs_device, sector);
+    }
+  if (pos > ra->ahead)
+    ra->ahead = pos;
+
+  rwlock_release_read (&inode->rw);
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
    less than SIZE if an error occurs. If EOF is exceed, the file
    will be extended to OFFSET + SIZE. Note that sparse file is
    supported, in that the sectors between previous length and
-   OFFSET is not initialized until someone read or write on it. */
+   OFFSET is not initialized until someone writes on it.  Writers
+   exclude readers and each other. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset)
@@ -541,27 +1033,27 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
 
-  lock_acquire (&inode->lock);
+  rwlock_acquire_write (&inode->rw);
 
   if (inode->deny_write_cnt) {
-      lock_release (&inode->lock);
+      rwlock_release_write (&inode->rw);
       return 0;
   }
 
-  if (inode_length (inode) < offset + size)
+  if (inode_disk_length (inode) < offset + size)
     {
-      off_t new_length = size + offset;
-      cache_write (fs_device, inode->sector, &new_length,
-                   offsetof (struct inode_disk, length), sizeof (off_t));
+      inode->data.length = size + offset;
+      inode_write_disk (inode->sector, &inode->data,
+                        offsetof (struct inode_disk, length), sizeof (off_t));
     }
 
   while (size > 0)
     {
       /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = inode_create_sector (inode->sector, offset);
+      block_sector_t sector_idx = inode_write_sector (inode, offset);
       if (sector_idx == 0)
         {
-          lock_release (&inode->lock);
+          rwlock_release_write (&inode->rw);
           return bytes_written;
         }
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
@@ -572,7 +1064,8 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       /* Number of bytes to actually write into this sector. */
       int chunk_size = size < sector_left ? size : sector_left;
 
-      cache_write (fs_device, sector_idx, buffer + bytes_written, sector_ofs, chunk_size);
+      cache_write (fs_device, sector_idx, inode->data_class,
+                   buffer + bytes_written, sector_ofs, chunk_size);
 
       /* Advance. */
       size -= chunk_size;
@@ -580,22 +1073,25 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       bytes_written += chunk_size;
     }
 
-  lock_release (&inode->lock);
+  rwlock_release_write (&inode->rw);
 
   return bytes_written;
 }
 
-/* Disables writes to INODE.
+/* Disables writes to INODE, waiting for a write in progress to
+   finish.
    May be called at most once per inode opener. */
 void
 inode_deny_write (struct inode *inode)
 {
+  rwlock_acquire_write (&inode->rw);
   lock_acquire (&inode->lock);
 
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
 
   lock_release (&inode->lock);
+  rwlock_release_write (&inode->rw);
 }
 
 /* Re-enables writes to INODE.
@@ -604,6 +1100,7 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode)
 {
+  rwlock_acquire_write (&inode->rw);
   lock_acquire (&inode->lock);
 
   ASSERT (inode->deny_write_cnt > 0);
@@ -611,6 +1108,7 @@ inode_allow_write (struct inode *inode)
   inode->deny_write_cnt--;
 
   lock_release (&inode->lock);
+  rwlock_release_write (&inode->rw);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -618,7 +1116,50 @@ off_t
 inode_length (struct inode *inode)
 {
   off_t length;
-  cache_read (fs_device, inode->sector, &length,
-              offsetof (struct inode_disk, length), sizeof (off_t));
+
+  rwlock_acquire_read (&inode->rw);
+  length = inode_disk_length (inode);
+  rwlock_release_read (&inode->rw);
+
   return length;
 }
+
+/* Returns the number of runs of consecutive sectors that hold
+   INODE's data, and stores the number of its data sectors in
+   *SECTORS.  Holes, and blocks whose allocation is delayed, are not
+   counted. */
+size_t
+inode_fragments (struct inode *inode, size_t *sectors)
+{
+  block_sector_t prev = 0;
+  size_t frag_cnt = 0;
+  off_t length, pos;
+
+  *sectors = 0;
+  rwlock_acquire_read (&inode->rw);
+  length = inode_disk_length (inode);
+  for (pos = 0; pos < length; pos += BLOCK_SECTOR_SIZE)
+    {
+      block_sector_t sector = inode_get_sector (inode, pos, true);
+      if (cache_delayed (sector))
+        sector = 0;
+      if (sector != 0)
+        {
+          if (prev == 0 || sector != prev + 1)
+            frag_cnt++;
+          (*sectors)++;
+        }
+      prev = sector;
+    }
+  rwlock_release_read (&inode->rw);
+
+  return frag_cnt;
+}
+
+/* Makes the buffer cache count INODE's data as CLASS, such as
+   CACHE_DIR for a directory. */
+void
+inode_set_class (struct inode *inode, enum cache_class class)
+{
+  inode->data_class = class;
+}
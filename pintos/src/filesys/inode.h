@@ -2,12 +2,24 @@
 #define FILESYS_INODE_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include "filesys/off_t.h"
 #include "devices/block.h"
+#include "filesys/cache.h"
 
 struct bitmap;
 
+/* Sequential read-ahead state of an open file. */
+struct readahead
+  {
+    off_t next;                 /* Offset a sequential read starts at. */
+    off_t ahead;                /* End of the sectors already queued. */
+    int window;                 /* Sectors to read ahead, 0 if off. */
+  };
+
 void inode_init (void);
+void inode_use_extents (bool);
+void inode_delay_alloc (bool);
 bool inode_create (block_sector_t, off_t);
 struct inode *inode_open (block_sector_t);
 struct inode *inode_reopen (struct inode *);
@@ -15,9 +27,15 @@ block_sector_t inode_get_inumber (const struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
+void inode_readahead_init (struct readahead *);
+void inode_readahead (struct inode *, struct readahead *,
+                      off_t offset, off_t size);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (struct inode *);
+size_t inode_fragments (struct inode *, size_t *sectors);
+void inode_set_class (struct inode *, enum cache_class);
+void inode_flush_delayed (void);
 
 #endif /* filesys/inode.h */
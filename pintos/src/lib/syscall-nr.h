@@ -32,7 +32,13 @@ enum
     SYS_INUMBER,                /* Returns the inode number for a fd. */
     SYS_WRITE_CNT,              /* Returns the write count of file system's block device. */
     SYS_HIT_RATE,               /* Returns the cache's hit rate. */
-    SYS_CACHE_RESET             /* Reset the cache. */
+    SYS_CACHE_RESET,            /* Reset the cache. */
+    SYS_SCHED_STATS,            /* Returns scheduler statistics. */
+    SYS_READ_CNT,               /* Returns the read count of file system's block device. */
+    SYS_CACHE_REPLAY,           /* Replays cache accesses under a policy. */
+    SYS_CACHE_STATS,            /* Returns buffer cache statistics. */
+    SYS_FRAGMENTS,              /* Counts the runs of sectors of a file. */
+    SYS_TICKS                   /* Returns the timer ticks since boot. */
   };
 
 #endif /* lib/syscall-nr.h */
@@ -92,6 +92,42 @@ cache_reset (void)
   syscall0 (SYS_CACHE_RESET);
 }
 
+void
+sched_stats (struct sched_stats *stats)
+{
+  syscall1 (SYS_SCHED_STATS, stats);
+}
+
+unsigned
+read_cnt (void)
+{
+  return syscall0 (SYS_READ_CNT);
+}
+
+int
+cache_replay (const char *policy)
+{
+  return syscall1 (SYS_CACHE_REPLAY, policy);
+}
+
+void
+cache_stats (struct cache_stats *stats)
+{
+  syscall1 (SYS_CACHE_STATS, stats);
+}
+
+int
+fragments (int fd)
+{
+  return syscall1 (SYS_FRAGMENTS, fd);
+}
+
+unsigned
+ticks (void)
+{
+  return syscall0 (SYS_TICKS);
+}
+
 void
 exit (int status)
 {
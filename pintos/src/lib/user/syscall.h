@@ -21,6 +21,52 @@ typedef int mapid_t;
 #define EXIT_SUCCESS 0          /* Successful execution. */
 #define EXIT_FAILURE 1          /* Unsuccessful execution. */
 
+/* Number of buckets in sched_stats' wait_hist.  Bucket 0 counts
+   waits of 0 ticks, bucket B > 0 counts waits of 2**(B-1) to
+   2**B - 1 ticks, and the last bucket also counts every longer
+   wait. */
+#define SCHED_WAIT_BUCKETS 12
+
+/* Scheduler statistics reported by sched_stats(). */
+struct sched_stats
+  {
+    long long run_ticks;                /* Ticks this process has run. */
+    long long wait_ticks;               /* Ticks it has spent ready. */
+    unsigned voluntary_switches;        /* Switched out by blocking. */
+    unsigned involuntary_switches;      /* Switched out while runnable. */
+    unsigned wait_hist[SCHED_WAIT_BUCKETS]; /* System-wide run-queue
+                                               wait time histogram. */
+  };
+
+/* Indices of the classes in cache_stats' CLASSES. */
+#define CACHE_STAT_INODE 0              /* Inode sectors. */
+#define CACHE_STAT_INDEX 1              /* Indirect blocks. */
+#define CACHE_STAT_DIR 2                /* Directory data. */
+#define CACHE_STAT_DATA 3               /* File data. */
+#define CACHE_STAT_CLASSES 4            /* Number of classes. */
+
+/* Buffer cache statistics reported by cache_stats().  The
+   counters cover accesses since the last cache_reset(), which
+   zeroes them all at once; SECTORS and DIRTY describe the cache
+   now. */
+struct cache_stats
+  {
+    struct
+      {
+        unsigned sectors;               /* Sectors now cached. */
+        unsigned dirty;                 /* Of those, sectors now dirty. */
+        unsigned hits;                  /* Accesses that found the sector. */
+        unsigned readahead_hits;        /* Accesses that found it
+                                           prefetched. */
+        unsigned misses;                /* Accesses that had to load it. */
+        unsigned evictions;             /* Sectors evicted. */
+        unsigned writebacks;            /* Dirty sectors written back. */
+        unsigned miss_ticks;            /* Average ticks to load on a
+                                           miss. */
+      }
+    classes[CACHE_STAT_CLASSES];
+  };
+
 /* Projects 2 and later. */
 void halt (void) NO_RETURN;
 void exit (int status) NO_RETURN;
@@ -50,5 +96,11 @@ int inumber (int fd);
 unsigned write_cnt (void);
 int hit_rate (void);
 void cache_reset (void);
+void sched_stats (struct sched_stats *);
+unsigned read_cnt (void);
+int cache_replay (const char *policy);
+void cache_stats (struct cache_stats *);
+int fragments (int fd);
+unsigned ticks (void);
 
 #endif /* lib/user/syscall.h */
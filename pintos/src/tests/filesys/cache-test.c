@@ -0,0 +1,30 @@
+#include "tests/filesys/cache-test.h"
+#include <syscall.h>
+#include "tests/lib.h"
+
+/* Returns the number of accesses to sectors of CLASS, one of the
+   CACHE_STAT_* indices, counted in STATS. */
+unsigned
+cache_accesses (const struct cache_stats *stats, int class)
+{
+  return (stats->classes[class].hits + stats->classes[class].readahead_hits
+          + stats->classes[class].misses);
+}
+
+/* Checks that reading SECTORS data sectors since the last
+   cache_reset() took fewer than SECTORS / 2 data accesses, as it
+   should when the sectors lie together in multi-sector cache
+   blocks and are copied out of each block at once. */
+void
+check_data_accesses (int sectors)
+{
+  struct cache_stats stats;
+  unsigned accesses;
+
+  cache_stats (&stats);
+  accesses = cache_accesses (&stats, CACHE_STAT_DATA);
+  if (accesses >= (unsigned) sectors / 2)
+    fail ("%u data accesses to read %d sectors", accesses, sectors);
+  msg ("Fewer than %d data accesses to read %d sectors.",
+       sectors / 2, sectors);
+}
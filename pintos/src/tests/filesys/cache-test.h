@@ -0,0 +1,9 @@
+#ifndef TESTS_FILESYS_CACHE_TEST_H
+#define TESTS_FILESYS_CACHE_TEST_H
+
+#include <syscall.h>
+
+unsigned cache_accesses (const struct cache_stats *, int class);
+void check_data_accesses (int sectors);
+
+#endif /* tests/filesys/cache-test.h */
@@ -0,0 +1,61 @@
+/* Runs with 8-sector cache blocks.  Writes a 16-sector file and
+   resets the cache, then reads the whole file at once, which
+   should take far fewer data accesses than one per sector since
+   consecutive sectors are copied out of a block together.  Then
+   overwrites part of one sector and the whole of another in a cold
+   cache, so that their blocks hold only some sectors, and reads
+   the file back to make sure the missing sectors were filled in
+   from disk. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/filesys/cache-test.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SECTORS 16
+
+static char buf[SECTORS * 512];
+static char expected[SECTORS * 512];
+
+/* Reads all of FD into BUF and compares it with EXPECTED. */
+static void
+check_contents (int fd)
+{
+  seek (fd, 0);
+  CHECK (read (fd, buf, sizeof buf) == sizeof buf, "read file0");
+  compare_bytes (buf, expected, sizeof buf, 0, "file0");
+}
+
+void
+test_main (void)
+{
+  int fd;
+
+  random_bytes (expected, sizeof expected);
+  CHECK (create ("file0", 0), "create \"file0\"");
+  CHECK ((fd = open ("file0")) > 1, "open \"file0\"");
+  CHECK (write (fd, expected, sizeof expected) == sizeof expected,
+         "write %d sectors", SECTORS);
+
+  msg ("Reset cache.");
+  cache_reset ();
+  check_contents (fd);
+  check_data_accesses (SECTORS);
+
+  msg ("Reset cache.");
+  cache_reset ();
+  memset (expected + 700, 'x', 100);
+  seek (fd, 700);
+  CHECK (write (fd, expected + 700, 100) == 100, "write part of sector 1");
+  memset (expected + 9 * 512, 'y', 512);
+  seek (fd, 9 * 512);
+  CHECK (write (fd, expected + 9 * 512, 512) == 512, "write all of sector 9");
+  check_contents (fd);
+
+  msg ("Reset cache.");
+  cache_reset ();
+  check_contents (fd);
+  close (fd);
+}
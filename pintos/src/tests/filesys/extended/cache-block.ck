@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(cache-block) begin
+(cache-block) create "file0"
+(cache-block) open "file0"
+(cache-block) write 16 sectors
+(cache-block) Reset cache.
+(cache-block) read file0
+(cache-block) Fewer than 8 data accesses to read 16 sectors.
+(cache-block) Reset cache.
+(cache-block) write part of sector 1
+(cache-block) write all of sector 9
+(cache-block) read file0
+(cache-block) Reset cache.
+(cache-block) read file0
+(cache-block) end
+EOF
+pass;
@@ -0,0 +1,64 @@
+/* Microbenchmark for buffer cache lookups that hit.
+
+   For working sets of several sizes, all small enough to stay in
+   the cache, creates a file of that many sectors and then reads
+   4 bytes at a time from each of its sectors in turn.  Each such
+   read looks up the inode, possibly an indirect block, and the
+   data sector in the cache, so the time it takes is dominated
+   by cache lookups.  Reports the number of reads and the CPU
+   ticks they took, as measured by sched_stats(). */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define READ_CNT 20000
+
+static const int working_sets[] = {4, 16, 32, 48};
+
+static char zeros[512];
+
+static void
+measure (int sectors)
+{
+  struct sched_stats before, after;
+  char file_name[16];
+  char word[4];
+  int fd, i;
+
+  snprintf (file_name, sizeof file_name, "ws%d", sectors);
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  for (i = 0; i < sectors; i++)
+    CHECK (write (fd, zeros, sizeof zeros) == sizeof zeros,
+           "write \"%s\"", file_name);
+
+  /* Warm up the cache. */
+  for (i = 0; i < sectors; i++)
+    {
+      seek (fd, i * sizeof zeros);
+      read (fd, word, sizeof word);
+    }
+
+  sched_stats (&before);
+  for (i = 0; i < READ_CNT; i++)
+    {
+      seek (fd, (i % sectors) * sizeof zeros);
+      read (fd, word, sizeof word);
+    }
+  sched_stats (&after);
+  close (fd);
+
+  msg ("%d sectors: %d reads in %lld ticks", sectors, READ_CNT,
+       after.run_ticks - before.run_ticks);
+}
+
+void
+test_main (void)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof working_sets / sizeof *working_sets; i++)
+    measure (working_sets[i]);
+}
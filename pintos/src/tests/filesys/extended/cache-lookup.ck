@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+@output = get_core_output ("run", @output);
+
+# The timings vary from run to run, so only check that every
+# working set was measured and that the run finished.
+my ($rounds) = 0;
+foreach (@output) {
+    my ($sectors, $reads, $ticks) = /(\d+) sectors: (\d+) reads in (\d+) ticks/
+      or next;
+    if ($ticks > 0) {
+        printf "%d sectors: %d reads/second\n", $sectors, $reads * 100 / $ticks;
+    }
+    $rounds++;
+}
+fail "Expected 4 working sets, found $rounds.\n" if $rounds != 4;
+pass;
@@ -0,0 +1,95 @@
+/* Trace-replay benchmark for the buffer cache replacement
+   policies.
+
+   Runs two workloads, each from a cold cache, so that the kernel
+   records the sectors they access.  After each one, replays the
+   recorded accesses under every replacement policy and reports
+   the percentage that hit:
+
+     - scan: a small file read over and over, with a sequential
+       read of a file much bigger than the cache in between, as
+       when a large file is copied while a small one is in use.
+
+     - loop: a file a little bigger than the cache read
+       sequentially several times, which defeats LRU. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define HOT_SECTORS 8
+#define BIG_SECTORS 192
+#define LOOP_SECTORS 80
+
+static const char *policies[] = {"clock", "lru", "2q", "arc"};
+
+static char buf[512];
+
+/* Creates FILE_NAME with SECTORS sectors of data. */
+static void
+make_file (const char *file_name, int sectors)
+{
+  int fd, i;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  for (i = 0; i < sectors; i++)
+    if (write (fd, buf, sizeof buf) != (int) sizeof buf)
+      fail ("write \"%s\" failed", file_name);
+  close (fd);
+}
+
+/* Reads all of FILE_NAME, which is SECTORS sectors long, one
+   sector at a time. */
+static void
+read_file (const char *file_name, int sectors)
+{
+  int fd, i;
+
+  if ((fd = open (file_name)) < 2)
+    fail ("open \"%s\" failed", file_name);
+  for (i = 0; i < sectors; i++)
+    if (read (fd, buf, sizeof buf) != (int) sizeof buf)
+      fail ("read \"%s\" failed", file_name);
+  close (fd);
+}
+
+/* Replays the accesses recorded for WORKLOAD under each policy. */
+static void
+replay (const char *workload)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof policies / sizeof *policies; i++)
+    {
+      int hits = cache_replay (policies[i]);
+      if (hits < 0)
+        fail ("no cache policy \"%s\"", policies[i]);
+      msg ("%s: %s %d%% hits", workload, policies[i], hits);
+    }
+}
+
+void
+test_main (void)
+{
+  int round, i;
+
+  make_file ("hot", HOT_SECTORS);
+  make_file ("big", BIG_SECTORS);
+  make_file ("loop", LOOP_SECTORS);
+
+  cache_reset ();
+  for (round = 0; round < 4; round++)
+    {
+      for (i = 0; i < 4; i++)
+        read_file ("hot", HOT_SECTORS);
+      read_file ("big", BIG_SECTORS);
+    }
+  replay ("scan");
+
+  cache_reset ();
+  for (round = 0; round < 4; round++)
+    read_file ("loop", LOOP_SECTORS);
+  replay ("loop");
+}
@@ -0,0 +1,24 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+@output = get_core_output ("run", @output);
+
+# Which policy does best depends on the workload, so only check
+# that every policy was replayed on every workload and report the
+# hit rates.
+my ($replays) = 0;
+foreach (@output) {
+    my ($workload, $policy, $hits) = /(\w+): (\w+) (-?\d+)% hits/
+      or next;
+    fail "$workload: $policy hit rate $hits% out of range.\n"
+      if $hits < 0 || $hits > 100;
+    printf "%s: %s %d%% hits\n", $workload, $policy, $hits;
+    $replays++;
+}
+fail "Expected 8 replays, found $replays.\n" if $replays != 8;
+pass;
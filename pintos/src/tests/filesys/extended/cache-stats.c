@@ -0,0 +1,86 @@
+/* Checks the buffer cache statistics reported by cache_stats().
+
+   Writes a 4-sector file and resets the cache, which must zero
+   every statistic.  Then reads the file's sectors twice in
+   descending order, which read-ahead ignores, so that every data
+   access is an ordinary miss the first time and a hit the second.
+   Then dirties one sector and resets the cache again. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SECTORS 4
+
+static char buf[512];
+
+/* Checks that every statistic in every class is zero. */
+static void
+check_zero (void)
+{
+  struct cache_stats stats;
+  int i;
+
+  cache_stats (&stats);
+  for (i = 0; i < CACHE_STAT_CLASSES; i++)
+    if (stats.classes[i].sectors != 0 || stats.classes[i].dirty != 0
+        || stats.classes[i].hits != 0
+        || stats.classes[i].readahead_hits != 0
+        || stats.classes[i].misses != 0
+        || stats.classes[i].evictions != 0
+        || stats.classes[i].writebacks != 0
+        || stats.classes[i].miss_ticks != 0)
+      fail ("class %d statistics not zero after reset", i);
+  CHECK (hit_rate () == 0, "hit rate is 0 with no accesses");
+}
+
+void
+test_main (void)
+{
+  struct cache_stats stats;
+  int fd, pass, i;
+
+  CHECK (create ("file0", 0), "create \"file0\"");
+  CHECK ((fd = open ("file0")) > 1, "open \"file0\"");
+  for (i = 0; i < SECTORS; i++)
+    CHECK (write (fd, buf, sizeof buf) == sizeof buf, "write sector %d", i);
+
+  msg ("Reset cache.");
+  cache_reset ();
+  check_zero ();
+
+  msg ("Read file0 twice, last sector first.");
+  for (pass = 0; pass < 2; pass++)
+    for (i = SECTORS - 1; i >= 0; i--)
+      {
+        seek (fd, i * sizeof buf);
+        if (read (fd, buf, sizeof buf) != sizeof buf)
+          fail ("read sector %d failed", i);
+      }
+  cache_stats (&stats);
+  CHECK (stats.classes[CACHE_STAT_DATA].misses == SECTORS,
+         "%d data misses", SECTORS);
+  CHECK (stats.classes[CACHE_STAT_DATA].hits == SECTORS,
+         "%d data hits", SECTORS);
+  CHECK (stats.classes[CACHE_STAT_DATA].readahead_hits == 0,
+         "no read-ahead hits");
+  CHECK (stats.classes[CACHE_STAT_DATA].sectors == SECTORS,
+         "%d data sectors cached", SECTORS);
+  CHECK (stats.classes[CACHE_STAT_DATA].evictions == 0
+         && stats.classes[CACHE_STAT_DATA].writebacks == 0
+         && stats.classes[CACHE_STAT_DATA].dirty == 0,
+         "no evictions, write-backs, or dirty data");
+
+  msg ("Write 1 byte to sector 0.");
+  seek (fd, 0);
+  CHECK (write (fd, buf, 1) == 1, "write 1 byte");
+  cache_stats (&stats);
+  CHECK (stats.classes[CACHE_STAT_DATA].hits == SECTORS + 1,
+         "%d data hits", SECTORS + 1);
+  CHECK (stats.classes[CACHE_STAT_DATA].dirty == 1, "1 dirty data sector");
+
+  msg ("Reset cache.");
+  cache_reset ();
+  check_zero ();
+  close (fd);
+}
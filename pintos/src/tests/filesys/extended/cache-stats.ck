@@ -0,0 +1,29 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(cache-stats) begin
+(cache-stats) create "file0"
+(cache-stats) open "file0"
+(cache-stats) write sector 0
+(cache-stats) write sector 1
+(cache-stats) write sector 2
+(cache-stats) write sector 3
+(cache-stats) Reset cache.
+(cache-stats) hit rate is 0 with no accesses
+(cache-stats) Read file0 twice, last sector first.
+(cache-stats) 4 data misses
+(cache-stats) 4 data hits
+(cache-stats) no read-ahead hits
+(cache-stats) 4 data sectors cached
+(cache-stats) no evictions, write-backs, or dirty data
+(cache-stats) Write 1 byte to sector 0.
+(cache-stats) write 1 byte
+(cache-stats) 5 data hits
+(cache-stats) 1 dirty data sector
+(cache-stats) Reset cache.
+(cache-stats) hit rate is 0 with no accesses
+(cache-stats) end
+EOF
+pass;
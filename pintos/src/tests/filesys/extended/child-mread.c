@@ -0,0 +1,57 @@
+/* Child process for multi-read.
+   Waits for the go file to appear, then reads the test file one
+   sector per read call until WINDOW ticks have passed, checking
+   every sector against the expected data, and returns the number
+   of sectors it read.  With "cold" as argument, it steps through
+   the file by a large stride, so that reads miss the cache and
+   defeat read-ahead; with "hot", it reads sector 0 each time. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/filesys/extended/multi-read.h"
+#include "tests/lib.h"
+
+const char *test_name = "child-mread";
+
+/* Sectors between the cold reader's reads.  Relatively prime to
+   FILE_SECTORS, so that it visits every sector. */
+#define STRIDE 97
+
+int
+main (int argc, const char *argv[])
+{
+  char expected[512], buf[512];
+  unsigned end;
+  bool cold;
+  int sectors = 0;
+  int idx = 0;
+  int fd, go;
+
+  quiet = true;
+
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  cold = !strcmp (argv[1], "cold");
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  sector_data (expected, 0);
+
+  while ((go = open (go_name)) <= 1)
+    continue;
+  close (go);
+  end = ticks () + WINDOW;
+
+  while (ticks () < end)
+    {
+      if (cold)
+        {
+          idx = (idx + STRIDE) % FILE_SECTORS;
+          sector_data (expected, idx);
+        }
+      seek (fd, idx * sizeof buf);
+      CHECK (read (fd, buf, sizeof buf) == sizeof buf,
+             "read sector %d of \"%s\"", idx, file_name);
+      compare_bytes (buf, expected, sizeof buf, idx * sizeof buf, file_name);
+      sectors++;
+    }
+  close (fd);
+  return sectors;
+}
@@ -0,0 +1,5 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+pass
\ No newline at end of file
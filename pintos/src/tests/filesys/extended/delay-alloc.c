@@ -0,0 +1,59 @@
+/* Runs with delayed allocation, 8-sector cache blocks, and a
+   cache big enough to hold every block written.  Appends to two
+   files by turns, a quarter sector at a time, so that allocating
+   each sector as it is written would interleave the files on disk.
+   Closes them and resets the cache, which gives the files their
+   sectors in one run each, then reads each file at once, which
+   should take few data accesses since its sectors follow one
+   another on disk. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/filesys/cache-test.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SECTORS 16
+#define CHUNK 128
+
+static char buf[SECTORS * 512];
+static char expected[2][SECTORS * 512];
+
+void
+test_main (void)
+{
+  static const char *names[2] = {"file0", "file1"};
+  int fd[2];
+  size_t ofs;
+  int i;
+
+  random_bytes (expected, sizeof expected);
+  for (i = 0; i < 2; i++)
+    {
+      CHECK (create (names[i], 0), "create \"%s\"", names[i]);
+      CHECK ((fd[i] = open (names[i])) > 1, "open \"%s\"", names[i]);
+    }
+
+  msg ("Append to both files by turns, %d bytes at a time.", CHUNK);
+  for (ofs = 0; ofs < sizeof buf; ofs += CHUNK)
+    for (i = 0; i < 2; i++)
+      if (write (fd[i], expected[i] + ofs, CHUNK) != CHUNK)
+        fail ("write %zu bytes at offset %zu in \"%s\" failed",
+              (size_t) CHUNK, ofs, names[i]);
+  msg ("close both files");
+  for (i = 0; i < 2; i++)
+    close (fd[i]);
+
+  for (i = 0; i < 2; i++)
+    {
+      msg ("Reset cache.");
+      cache_reset ();
+      CHECK ((fd[i] = open (names[i])) > 1, "open \"%s\"", names[i]);
+      CHECK (read (fd[i], buf, sizeof buf) == sizeof buf,
+             "read \"%s\"", names[i]);
+      compare_bytes (buf, expected[i], sizeof buf, 0, names[i]);
+      check_data_accesses (SECTORS);
+      close (fd[i]);
+    }
+}
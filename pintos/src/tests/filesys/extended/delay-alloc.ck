@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(delay-alloc) begin
+(delay-alloc) create "file0"
+(delay-alloc) open "file0"
+(delay-alloc) create "file1"
+(delay-alloc) open "file1"
+(delay-alloc) Append to both files by turns, 128 bytes at a time.
+(delay-alloc) close both files
+(delay-alloc) Reset cache.
+(delay-alloc) open "file0"
+(delay-alloc) read "file0"
+(delay-alloc) Fewer than 8 data accesses to read 16 sectors.
+(delay-alloc) Reset cache.
+(delay-alloc) open "file1"
+(delay-alloc) read "file1"
+(delay-alloc) Fewer than 8 data accesses to read 16 sectors.
+(delay-alloc) end
+EOF
+pass;
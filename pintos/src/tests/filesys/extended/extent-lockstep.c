@@ -0,0 +1,68 @@
+/* Grows two files in parallel one sector at a time.  Each new
+   extent is placed with room to grow on both sides, so the files
+   take turns on disk in runs of many sectors instead of one.
+   Checks that each file is in few fragments and that their
+   contents are correct. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SECTORS 300
+#define FILE_SIZE (SECTORS * 512)
+#define MAX_FRAGMENTS (SECTORS / 16)
+static char buf_a[FILE_SIZE];
+static char buf_b[FILE_SIZE];
+
+/* Checks that file NAME is in fewer than MAX_FRAGMENTS runs of
+   sectors. */
+static void
+check_fragments (const char *name)
+{
+  int fd, frags;
+
+  CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+  frags = fragments (fd);
+  if (frags < 1 || frags >= MAX_FRAGMENTS)
+    fail ("\"%s\" is in %d fragments", name, frags);
+  msg ("\"%s\" is in fewer than %d fragments", name, MAX_FRAGMENTS);
+  close (fd);
+}
+
+void
+test_main (void)
+{
+  int fd_a, fd_b;
+  size_t ofs;
+
+  random_init (0);
+  random_bytes (buf_a, sizeof buf_a);
+  random_bytes (buf_b, sizeof buf_b);
+
+  CHECK (create ("a", 0), "create \"a\"");
+  CHECK (create ("b", 0), "create \"b\"");
+
+  CHECK ((fd_a = open ("a")) > 1, "open \"a\"");
+  CHECK ((fd_b = open ("b")) > 1, "open \"b\"");
+
+  msg ("write \"a\" and \"b\" alternately");
+  for (ofs = 0; ofs < FILE_SIZE; ofs += 512)
+    {
+      if (write (fd_a, buf_a + ofs, 512) != 512)
+        fail ("write 512 bytes at offset %zu in \"a\" failed", ofs);
+      if (write (fd_b, buf_b + ofs, 512) != 512)
+        fail ("write 512 bytes at offset %zu in \"b\" failed", ofs);
+    }
+
+  msg ("close \"a\"");
+  close (fd_a);
+
+  msg ("close \"b\"");
+  close (fd_b);
+
+  check_fragments ("a");
+  check_fragments ("b");
+  check_file ("a", buf_a, FILE_SIZE);
+  check_file ("b", buf_b, FILE_SIZE);
+}
@@ -0,0 +1,26 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(extent-lockstep) begin
+(extent-lockstep) create "a"
+(extent-lockstep) create "b"
+(extent-lockstep) open "a"
+(extent-lockstep) open "b"
+(extent-lockstep) write "a" and "b" alternately
+(extent-lockstep) close "a"
+(extent-lockstep) close "b"
+(extent-lockstep) open "a"
+(extent-lockstep) "a" is in fewer than 18 fragments
+(extent-lockstep) open "b"
+(extent-lockstep) "b" is in fewer than 18 fragments
+(extent-lockstep) open "a" for verification
+(extent-lockstep) verified contents of "a"
+(extent-lockstep) close "a"
+(extent-lockstep) open "b" for verification
+(extent-lockstep) verified contents of "b"
+(extent-lockstep) close "b"
+(extent-lockstep) end
+EOF
+pass;
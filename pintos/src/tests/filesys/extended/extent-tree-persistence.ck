@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+my ($a) = random_bytes (307200);
+my ($b) = random_bytes (307200);
+for (my $ofs = 0; $ofs < 307200; $ofs += 1024)
+  {
+    substr ($a, $ofs, 512) = "\0" x 512;
+    substr ($b, $ofs, 512) = "\0" x 512;
+  }
+check_archive ({"a" => [$a], "b" => [$b]});
+pass;
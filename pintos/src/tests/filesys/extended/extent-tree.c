@@ -0,0 +1,56 @@
+/* Grows two sparse files in parallel, writing every other sector
+   of each in turn.  Every sector written starts a new extent, so
+   each file needs hundreds of extents, more than fit in an inode.
+   Checks that their contents are correct. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SECTORS 600
+#define FILE_SIZE (SECTORS * 512)
+static char buf_a[FILE_SIZE];
+static char buf_b[FILE_SIZE];
+
+void
+test_main (void)
+{
+  int fd_a, fd_b;
+  size_t ofs;
+
+  random_init (0);
+  random_bytes (buf_a, sizeof buf_a);
+  random_bytes (buf_b, sizeof buf_b);
+
+  CHECK (create ("a", 0), "create \"a\"");
+  CHECK (create ("b", 0), "create \"b\"");
+
+  CHECK ((fd_a = open ("a")) > 1, "open \"a\"");
+  CHECK ((fd_b = open ("b")) > 1, "open \"b\"");
+
+  msg ("write odd sectors of \"a\" and \"b\" alternately");
+  for (ofs = 512; ofs < FILE_SIZE; ofs += 1024)
+    {
+      seek (fd_a, ofs);
+      if (write (fd_a, buf_a + ofs, 512) != 512)
+        fail ("write 512 bytes at offset %zu in \"a\" failed", ofs);
+      seek (fd_b, ofs);
+      if (write (fd_b, buf_b + ofs, 512) != 512)
+        fail ("write 512 bytes at offset %zu in \"b\" failed", ofs);
+
+      /* The even sectors are holes, which read as zeros. */
+      memset (buf_a + ofs - 512, 0, 512);
+      memset (buf_b + ofs - 512, 0, 512);
+    }
+
+  msg ("close \"a\"");
+  close (fd_a);
+
+  msg ("close \"b\"");
+  close (fd_b);
+
+  check_file ("a", buf_a, FILE_SIZE);
+  check_file ("b", buf_b, FILE_SIZE);
+}
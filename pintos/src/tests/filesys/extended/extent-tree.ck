@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(extent-tree) begin
+(extent-tree) create "a"
+(extent-tree) create "b"
+(extent-tree) open "a"
+(extent-tree) open "b"
+(extent-tree) write odd sectors of "a" and "b" alternately
+(extent-tree) close "a"
+(extent-tree) close "b"
+(extent-tree) open "a" for verification
+(extent-tree) verified contents of "a"
+(extent-tree) close "a"
+(extent-tree) open "b" for verification
+(extent-tree) verified contents of "b"
+(extent-tree) close "b"
+(extent-tree) end
+EOF
+pass;
@@ -0,0 +1,47 @@
+/* Runs on a 16 MB disk, whose free map takes 8 sectors.  Grows a
+   file by 256 sectors, one sector at a time, and then resets the
+   cache to write everything back.  Only the free map sector that
+   covers the new sectors changes, and only it should be written
+   back, so the block device's write_cnt should grow by the data
+   sectors and a few metadata sectors, not by the whole free
+   map. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SECTORS 256
+
+static char buf[512];
+
+void
+test_main (void)
+{
+  unsigned before, increase;
+  int fd;
+  int i;
+
+  CHECK (create ("file0", 0), "create \"file0\"");
+  CHECK ((fd = open ("file0")) > 1, "open \"file0\"");
+
+  msg ("Reset cache.");
+  cache_reset ();
+  before = write_cnt ();
+
+  msg ("Writing %d sectors to file0 one sector at a time...", SECTORS);
+  for (i = 0; i < SECTORS; i++)
+    {
+      memset (buf, i + 1, sizeof buf);
+      if (write (fd, buf, sizeof buf) != (int) sizeof buf)
+        fail ("write %d failed", i);
+    }
+  close (fd);
+
+  msg ("Reset cache.");
+  cache_reset ();
+  increase = write_cnt () - before;
+  CHECK (increase >= SECTORS && increase < SECTORS + 6,
+         "Block device's write_cnt increased by at least %d and at most %d.",
+         SECTORS, SECTORS + 5);
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(free-map-writes) begin
+(free-map-writes) create "file0"
+(free-map-writes) open "file0"
+(free-map-writes) Reset cache.
+(free-map-writes) Writing 256 sectors to file0 one sector at a time...
+(free-map-writes) Reset cache.
+(free-map-writes) Block device's write_cnt increased by at least 256 and at most 261.
+(free-map-writes) end
+EOF
+pass;
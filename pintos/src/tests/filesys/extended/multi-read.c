@@ -0,0 +1,55 @@
+/* Checks that readers of one file do not exclude each other.
+   Writes a file much larger than the cache and empties the
+   cache, then runs two readers of the file over the same number
+   of ticks.  The cold reader reads sectors scattered over the
+   file, so nearly every read waits for the disk inside
+   inode_read_at(), while the hot reader reads the same cached
+   sector over and over.  Readers share the inode's lock, so the
+   hot reader keeps going while the cold one waits and should
+   read many more sectors; if they excluded each other, it would
+   wait out every one of the cold reader's disk reads instead.
+   Both check every sector against the expected data.  The check
+   script compares the two counts. */
+
+#include <syscall.h>
+#include "tests/filesys/extended/multi-read.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  char buf[512];
+  pid_t cold, hot;
+  int cold_sectors, hot_sectors;
+  int fd, i;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  for (i = 0; i < FILE_SECTORS; i++)
+    {
+      sector_data (buf, i);
+      if (write (fd, buf, sizeof buf) != sizeof buf)
+        fail ("write sector %d of \"%s\"", i, file_name);
+    }
+  msg ("close \"%s\"", file_name);
+  close (fd);
+
+  msg ("Reset cache.");
+  cache_reset ();
+
+  /* exec() returns once a child has loaded, so both readers are
+     ready to start by the time the go file appears. */
+  CHECK ((cold = exec ("child-mread cold")) != PID_ERROR,
+         "exec \"child-mread cold\"");
+  CHECK ((hot = exec ("child-mread hot")) != PID_ERROR,
+         "exec \"child-mread hot\"");
+  CHECK (create (go_name, 0), "create \"%s\"", go_name);
+
+  cold_sectors = wait (cold);
+  hot_sectors = wait (hot);
+  if (cold_sectors < 0 || hot_sectors < 0)
+    fail ("reader failed");
+  msg ("cold reader: %d sectors in %d ticks", cold_sectors, WINDOW);
+  msg ("hot reader: %d sectors in %d ticks", hot_sectors, WINDOW);
+}
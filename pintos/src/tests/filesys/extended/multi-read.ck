@@ -0,0 +1,28 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+@output = get_core_output ("run", @output);
+
+# The hot reader runs while the cold reader waits for the disk
+# with the inode's lock held for reading, so it should read many
+# times as many sectors.  Readers that excluded each other would
+# leave it at most about as many as the cold reader.
+my (%sectors);
+foreach (@output) {
+    my ($reader, $cnt) = /(cold|hot) reader: (\d+) sectors in \d+ ticks/
+      or next;
+    $sectors{$reader} = $cnt;
+    print "$_\n";
+}
+fail "No sector count for cold reader.\n" if !defined $sectors{cold};
+fail "No sector count for hot reader.\n" if !defined $sectors{hot};
+fail "Cold reader read no sectors.\n" if $sectors{cold} == 0;
+fail "Hot reader read $sectors{hot} sectors, fewer than 4 times "
+  . "cold reader's $sectors{cold}.\n"
+  if $sectors{hot} < $sectors{cold} * 4;
+pass;
@@ -0,0 +1,26 @@
+#ifndef TESTS_FILESYS_EXTENDED_MULTI_READ_H
+#define TESTS_FILESYS_EXTENDED_MULTI_READ_H
+
+#include <random.h>
+
+/* The test file, 8 times the size of the default cache. */
+#define FILE_SECTORS 512
+static const char file_name[] = "shared";
+
+/* File whose creation starts both readers. */
+static const char go_name[] = "go";
+
+/* Ticks over which each reader's reads are counted, starting
+   from the tick it sees the go file. */
+#define WINDOW 100
+
+/* Fills BUF with the expected contents of sector IDX of the test
+   file. */
+static inline void
+sector_data (char buf[512], int idx)
+{
+  random_init (idx);
+  random_bytes (buf, 512);
+}
+
+#endif /* tests/filesys/extended/multi-read.h */
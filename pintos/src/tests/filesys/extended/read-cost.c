@@ -0,0 +1,58 @@
+/* Benchmarks the buffer cache accesses that reading a file takes.
+   Writes a 256 kB file, which under -inode-map=blocks needs the
+   inode's direct, indirect, and doubly indirect pointers, and
+   resets the cache.  Then reads the file back sequentially, 4 kB
+   at a time, and reports the cache accesses of each class per MB
+   read.  Reads should not have to go through the cache for the
+   inode itself, and should take exactly one access per data
+   sector. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/filesys/cache-test.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (256 * 1024)
+#define CHUNK_SIZE 4096
+#define PER_MB (1024 * 1024 / FILE_SIZE)
+
+static char buf[CHUNK_SIZE];
+
+void
+test_main (void)
+{
+  static const char *class_names[CACHE_STAT_CLASSES] =
+    {"inode", "index", "dir", "data"};
+  struct cache_stats stats;
+  unsigned total = 0;
+  int fd, ofs, i;
+
+  random_bytes (buf, sizeof buf);
+  CHECK (create ("bench", 0), "create \"bench\"");
+  CHECK ((fd = open ("bench")) > 1, "open \"bench\"");
+  for (ofs = 0; ofs < FILE_SIZE; ofs += CHUNK_SIZE)
+    if (write (fd, buf, CHUNK_SIZE) != CHUNK_SIZE)
+      fail ("write at offset %d failed", ofs);
+
+  msg ("Reset cache.");
+  cache_reset ();
+
+  msg ("Read %d kB sequentially.", FILE_SIZE / 1024);
+  seek (fd, 0);
+  for (ofs = 0; ofs < FILE_SIZE; ofs += CHUNK_SIZE)
+    if (read (fd, buf, CHUNK_SIZE) != CHUNK_SIZE)
+      fail ("read at offset %d failed", ofs);
+
+  cache_stats (&stats);
+  for (i = 0; i < CACHE_STAT_CLASSES; i++)
+    {
+      unsigned accesses = cache_accesses (&stats, i) * PER_MB;
+      msg ("%s: %u cache accesses per MB", class_names[i], accesses);
+      total += accesses;
+    }
+  msg ("total: %u cache accesses per MB", total);
+
+  close (fd);
+  CHECK (remove ("bench"), "remove \"bench\"");
+}
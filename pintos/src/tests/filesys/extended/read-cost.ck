@@ -0,0 +1,28 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+@output = get_core_output ("run", @output);
+
+# Only the inode and data counts are fixed: reads take no accesses
+# to the inode's own sector and one per data sector, 2048 per MB.
+# The rest depend on the file's layout, so just report them.
+my (%accesses);
+foreach (@output) {
+    my ($class, $cnt) = /(\w+): (\d+) cache accesses per MB/
+      or next;
+    $accesses{$class} = $cnt;
+    print "$class: $cnt cache accesses per MB\n";
+}
+foreach my $class (qw (inode index dir data total)) {
+    fail "No access count for $class.\n" if !defined $accesses{$class};
+}
+fail "$accesses{inode} inode accesses per MB, expected 0.\n"
+  if $accesses{inode} != 0;
+fail "$accesses{data} data accesses per MB, expected 2048.\n"
+  if $accesses{data} != 2048;
+pass;
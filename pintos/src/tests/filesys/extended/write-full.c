@@ -0,0 +1,54 @@
+/* Reset the buffer cache, then grow a file by whole sectors.
+   Newly allocated sectors that are overwritten in full should
+   not be read from disk first, so the block device's read_cnt
+   should grow by only a handful of metadata sectors, not by one
+   sector per sector written.  Finally, read the file back to make
+   sure that no stale data leaked through. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SECTOR_CNT 32
+
+static char buf[512];
+static char readback[512];
+
+void
+test_main (void)
+{
+  int fd;
+  int i;
+
+  CHECK (create ("file0", 0), "create \"file0\"");
+  CHECK ((fd = open ("file0")) > 1, "open \"file0\"");
+
+  msg ("Reset cache.");
+  cache_reset ();
+
+  msg ("Writing %d sectors to file0 one sector at a time...", SECTOR_CNT);
+  unsigned before = read_cnt ();
+  for (i = 0; i < SECTOR_CNT; i++)
+    {
+      memset (buf, i + 1, sizeof buf);
+      if (write (fd, buf, sizeof buf) != (int) sizeof buf)
+        fail ("write %d failed", i);
+    }
+  unsigned increase = read_cnt () - before;
+  CHECK (increase < SECTOR_CNT / 2,
+         "Block device's read_cnt increased by less than %d.",
+         SECTOR_CNT / 2);
+
+  msg ("Reading file0 back...");
+  seek (fd, 0);
+  for (i = 0; i < SECTOR_CNT; i++)
+    {
+      memset (buf, i + 1, sizeof buf);
+      if (read (fd, readback, sizeof readback) != (int) sizeof readback)
+        fail ("read %d failed", i);
+      if (memcmp (buf, readback, sizeof buf))
+        fail ("sector %d differs from what was written", i);
+    }
+  close (fd);
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(write-full) begin
+(write-full) create "file0"
+(write-full) open "file0"
+(write-full) Reset cache.
+(write-full) Writing 32 sectors to file0 one sector at a time...
+(write-full) Block device's read_cnt increased by less than 16.
+(write-full) Reading file0 back...
+(write-full) end
+EOF
+pass;
@@ -0,0 +1,91 @@
+/* Measures how much of the CPU is left to the idle thread while
+   a growing number of threads sleep in short, periodic
+   intervals.  Sleeping threads should not occupy the ready list,
+   so the idle thread should keep running for most of each
+   measurement window no matter how many sleepers there are. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Number of ticks each sleeper sleeps at a time. */
+#define SLEEP_PERIOD 5
+
+/* Number of ticks over which idle time is measured. */
+#define MEASURE_TICKS 200
+
+/* Information about one round of the test. */
+struct idle_test
+  {
+    int64_t end;                /* Tick at which sleepers stop. */
+    struct semaphore done;      /* Upped by each sleeper on exit. */
+  };
+
+static void measure_idle (int sleeper_cnt);
+static void sleeper (void *);
+
+void
+test_alarm_idle (void)
+{
+  static const int sleeper_cnts[] = {1, 10, 50, 100};
+  size_t i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  msg ("Each sleeper sleeps %d ticks at a time.", SLEEP_PERIOD);
+  msg ("Idle time is measured over %d ticks.", MEASURE_TICKS);
+
+  for (i = 0; i < sizeof sleeper_cnts / sizeof *sleeper_cnts; i++)
+    measure_idle (sleeper_cnts[i]);
+}
+
+/* Starts SLEEPER_CNT periodic sleepers and reports the number of
+   idle ticks seen while they run. */
+static void
+measure_idle (int sleeper_cnt)
+{
+  struct idle_test test;
+  long long idle_start, idle_end;
+  int64_t start, end;
+  int i;
+
+  test.end = timer_ticks () + SLEEP_PERIOD + MEASURE_TICKS + SLEEP_PERIOD;
+  sema_init (&test.done, 0);
+
+  for (i = 0; i < sleeper_cnt; i++)
+    {
+      char name[24];
+      snprintf (name, sizeof name, "sleeper %d", i);
+      thread_create (name, PRI_DEFAULT, sleeper, &test);
+    }
+
+  /* Let every sleeper go to sleep once before measuring. */
+  timer_sleep (SLEEP_PERIOD);
+
+  start = timer_ticks ();
+  idle_start = thread_get_idle_ticks ();
+  timer_sleep (MEASURE_TICKS);
+  end = timer_ticks ();
+  idle_end = thread_get_idle_ticks ();
+
+  for (i = 0; i < sleeper_cnt; i++)
+    sema_down (&test.done);
+
+  msg ("%d sleepers: %d of %d ticks idle.", sleeper_cnt,
+       (int) (idle_end - idle_start), (int) (end - start));
+}
+
+/* Sleeper thread. */
+static void
+sleeper (void *test_)
+{
+  struct idle_test *test = test_;
+
+  while (timer_ticks () < test->end)
+    timer_sleep (SLEEP_PERIOD);
+  sema_up (&test->done);
+}
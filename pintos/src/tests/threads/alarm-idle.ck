@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+@output = get_core_output ("run", @output);
+
+# Every round must leave the CPU idle for at least half of the
+# measurement window.
+my ($rounds) = 0;
+foreach (@output) {
+    my ($sleepers, $idle, $total) = /(\d+) sleepers: (\d+) of (\d+) ticks idle/
+      or next;
+    fail "$sleepers sleepers: only $idle of $total ticks were idle.\n"
+      if $idle * 2 < $total;
+    $rounds++;
+}
+fail "Expected 4 measurement rounds, found $rounds.\n" if $rounds != 4;
+pass;
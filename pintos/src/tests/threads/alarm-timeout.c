@@ -0,0 +1,112 @@
+/* Tests kernel timeouts and the timed variants of sema_down()
+   and cond_wait().  Checks that waits give up once their timeout
+   expires, that they return early when woken up in time, and
+   that immediate, deferred and cancelled timeouts behave. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timeout.h"
+#include "devices/timer.h"
+
+static struct semaphore sema;
+static struct lock lock;
+static struct condition cond;
+
+static thread_func sema_up_thread;
+static thread_func cond_signal_thread;
+static timeout_func record_tick;
+
+void
+test_alarm_timeout (void)
+{
+  struct timeout immediate, deferred, cancelled;
+  int64_t immediate_tick, deferred_tick, cancelled_tick;
+  int64_t start;
+  bool ok;
+
+  sema_init (&sema, 0);
+  lock_init (&lock);
+  cond_init (&cond);
+
+  msg ("sema_down_timeout() with nobody to up the semaphore.");
+  start = timer_ticks ();
+  ok = sema_down_timeout (&sema, 10);
+  if (ok || timer_elapsed (start) < 10)
+    fail ("returned %d after %d ticks", ok, (int) timer_elapsed (start));
+
+  msg ("sema_down_timeout() with a thread that ups after 5 ticks.");
+  thread_create ("sema-up", PRI_DEFAULT, sema_up_thread, NULL);
+  start = timer_ticks ();
+  ok = sema_down_timeout (&sema, 100);
+  if (!ok || timer_elapsed (start) >= 100)
+    fail ("returned %d after %d ticks", ok, (int) timer_elapsed (start));
+
+  msg ("cond_wait_timeout() with nobody to signal.");
+  lock_acquire (&lock);
+  start = timer_ticks ();
+  ok = cond_wait_timeout (&cond, &lock, 10);
+  if (ok || timer_elapsed (start) < 10 || !lock_held_by_current_thread (&lock))
+    fail ("returned %d after %d ticks", ok, (int) timer_elapsed (start));
+
+  msg ("cond_wait_timeout() with a thread that signals after 5 ticks.");
+  thread_create ("cond-signal", PRI_DEFAULT, cond_signal_thread, NULL);
+  start = timer_ticks ();
+  ok = cond_wait_timeout (&cond, &lock, 100);
+  if (!ok || timer_elapsed (start) >= 100 || !lock_held_by_current_thread (&lock))
+    fail ("returned %d after %d ticks", ok, (int) timer_elapsed (start));
+  lock_release (&lock);
+
+  msg ("Arming immediate, deferred and cancelled timeouts.");
+  immediate_tick = deferred_tick = cancelled_tick = -1;
+  timeout_init (&immediate, record_tick, &immediate_tick, false);
+  timeout_init (&deferred, record_tick, &deferred_tick, true);
+  timeout_init (&cancelled, record_tick, &cancelled_tick, false);
+  start = timer_ticks ();
+  timeout_arm (&immediate, 10);
+  timeout_arm (&deferred, 20);
+  timeout_arm (&cancelled, 15);
+  if (!timeout_cancel (&cancelled))
+    fail ("timeout_cancel() failed on a pending timeout");
+  timer_sleep (30);
+
+  if (immediate_tick - start < 10 || immediate_tick - start > 11)
+    fail ("immediate timeout ran %d ticks after arming",
+          (int) (immediate_tick - start));
+  if (deferred_tick - start < 20)
+    fail ("deferred timeout ran %d ticks after arming",
+          (int) (deferred_tick - start));
+  if (cancelled_tick != -1)
+    fail ("cancelled timeout ran");
+  if (timeout_pending (&immediate) || timeout_pending (&deferred))
+    fail ("expired timeouts still pending");
+
+  msg ("All timeouts behaved.");
+}
+
+static void
+sema_up_thread (void *aux UNUSED)
+{
+  timer_sleep (5);
+  sema_up (&sema);
+}
+
+static void
+cond_signal_thread (void *aux UNUSED)
+{
+  timer_sleep (5);
+  lock_acquire (&lock);
+  cond_signal (&cond, &lock);
+  lock_release (&lock);
+}
+
+/* Timeout function that stores the current tick in *TICK_. */
+static void
+record_tick (void *tick_)
+{
+  int64_t *tick = tick_;
+  *tick = timer_ticks ();
+}
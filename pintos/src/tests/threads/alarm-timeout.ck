@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(alarm-timeout) begin
+(alarm-timeout) sema_down_timeout() with nobody to up the semaphore.
+(alarm-timeout) sema_down_timeout() with a thread that ups after 5 ticks.
+(alarm-timeout) cond_wait_timeout() with nobody to signal.
+(alarm-timeout) cond_wait_timeout() with a thread that signals after 5 ticks.
+(alarm-timeout) Arming immediate, deferred and cancelled timeouts.
+(alarm-timeout) All timeouts behaved.
+(alarm-timeout) end
+EOF
+pass;
@@ -0,0 +1,44 @@
+/* Child process run by smp-matmult.
+   Multiplies two DIM x DIM integer matrices ROUNDS times, which
+   keeps a CPU busy in user mode for a second or so, then checks
+   the result. */
+
+#include "tests/lib.h"
+
+const char *test_name = "child-matmult";
+
+#define DIM 64
+#define ROUNDS 256
+
+static int a[DIM][DIM], b[DIM][DIM], c[DIM][DIM];
+
+int
+main (void)
+{
+  int round, i, j, k;
+
+  for (i = 0; i < DIM; i++)
+    for (j = 0; j < DIM; j++)
+      {
+        a[i][j] = i;
+        b[i][j] = j;
+      }
+
+  /* Start each sum from ROUND so that no round can be skipped. */
+  for (round = 0; round < ROUNDS; round++)
+    for (i = 0; i < DIM; i++)
+      for (j = 0; j < DIM; j++)
+        {
+          int sum = round;
+          for (k = 0; k < DIM; k++)
+            sum += a[i][k] * b[k][j];
+          c[i][j] = sum;
+        }
+
+  for (i = 0; i < DIM; i++)
+    for (j = 0; j < DIM; j++)
+      if (c[i][j] != DIM * i * j + ROUNDS - 1)
+        fail ("c[%d][%d] is %d, expected %d",
+              i, j, c[i][j], DIM * i * j + ROUNDS - 1);
+  return 0;
+}
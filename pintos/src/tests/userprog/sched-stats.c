@@ -0,0 +1,33 @@
+/* Spins for a while and checks that the sched_stats syscall
+   reports CPU time and a consistent run-queue wait histogram
+   for the calling thread. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  struct sched_stats before, after;
+  volatile int x = 0;
+  unsigned hist_sum;
+  int i;
+
+  sched_stats (&before);
+  for (i = 0; i < 20000000; i++)
+    x++;
+  sched_stats (&after);
+
+  CHECK (after.run_ticks > before.run_ticks, "run_ticks advanced");
+  CHECK (after.wait_ticks >= before.wait_ticks, "wait_ticks monotonic");
+
+  hist_sum = 0;
+  for (i = 0; i < SCHED_WAIT_BUCKETS; i++)
+    {
+      if (after.wait_hist[i] < before.wait_hist[i])
+        fail ("wait_hist[%d] went backward", i);
+      hist_sum += after.wait_hist[i];
+    }
+  CHECK (hist_sum > 0, "wait histogram is populated");
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sched-stats) begin
+(sched-stats) run_ticks advanced
+(sched-stats) wait_ticks monotonic
+(sched-stats) wait histogram is populated
+(sched-stats) end
+sched-stats: exit(0)
+EOF
+pass;
@@ -0,0 +1,37 @@
+/* Times one CPU-bound child process, then CHILD_CNT of them at
+   once, on a machine with CHILD_CNT CPUs.  User processes run in
+   parallel on all CPUs, so the children together should take
+   little longer than one alone, given as many host CPUs.  The
+   check script requires every child to succeed and reports the
+   speedup. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHILD_CNT 4
+
+/* Runs CNT copies of child-matmult at once and returns the
+   number of timer ticks until all of them have exited. */
+static unsigned
+run_children (int cnt)
+{
+  pid_t children[CHILD_CNT];
+  unsigned start = ticks ();
+  int i;
+
+  for (i = 0; i < cnt; i++)
+    if ((children[i] = exec ("child-matmult")) == PID_ERROR)
+      fail ("exec \"child-matmult\" failed");
+  for (i = 0; i < cnt; i++)
+    if (wait (children[i]) != 0)
+      fail ("child %d of %d failed", i + 1, cnt);
+  return ticks () - start;
+}
+
+void
+test_main (void)
+{
+  msg ("1 process: %u ticks", run_children (1));
+  msg ("%d processes: %u ticks", CHILD_CNT, run_children (CHILD_CNT));
+}
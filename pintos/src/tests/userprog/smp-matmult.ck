@@ -0,0 +1,27 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+fail "Kernel did not start 4 CPUs.\n"
+  if !grep (/^4 of 4 CPUs started\.$/, @output);
+@output = get_core_output ("run", @output);
+
+# The children run in user mode, in parallel on 4 CPUs, so 4 of
+# them should take little longer than 1.  How much longer depends
+# on how many host CPUs the simulator really has, though, so the
+# speedup is only reported.
+my (%ticks);
+foreach (@output) {
+    my ($procs, $cnt) = /(\d+) process(?:es)?: (\d+) ticks/ or next;
+    $ticks{$procs} = $cnt;
+    print "$_\n";
+}
+fail "No time for 1 process.\n" if !defined $ticks{1};
+fail "No time for 4 processes.\n" if !defined $ticks{4};
+fail "1 process took no time.\n" if $ticks{1} == 0;
+printf "Speedup: %.2f\n", 4 * $ticks{1} / ($ticks{4} > 0 ? $ticks{4} : 1);
+pass;
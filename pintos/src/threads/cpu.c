@@ -0,0 +1,396 @@
+#include "threads/cpu.h"
+#include <debug.h>
+#include <packed.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/lapic.h"
+#include "devices/timer.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/spinlock.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef USERPROG
+#include "userprog/gdt.h"
+#endif
+
+/* Multiprocessor support.
+
+   The BIOS describes the machine's CPUs in the MP configuration
+   table [MP].  cpu_init() reads it, and cpu_start_aps() then
+   starts every other CPU through its local APIC.  Each CPU runs
+   threads from its own run queue (see thread.c) and receives the
+   timer tick from the first CPU as an inter-processor interrupt
+   (IPI).
+
+   Most of the kernel was written for one CPU and uses turning
+   interrupts off for mutual exclusion, so the kernel proper is
+   serialized by a big kernel lock: a CPU must hold it to run
+   kernel code, except in the idle loop, and releases it whenever
+   it returns to user mode.  User processes thus run in parallel
+   on all CPUs, while system calls and interrupt handlers take
+   turns. */
+
+/* Interrupt vectors for IPIs. */
+#define TICK_VEC 0xf0           /* Timer tick from the first CPU. */
+#define KICK_VEC 0xf1           /* New ready thread to consider. */
+
+/* CPUs.  The first is the one running main() and holds the big
+   kernel lock from boot. */
+struct cpu cpus[CPU_MAX] = {[0] = {.started = true, .kernel_locked = true}};
+int cpu_cnt = 1;                /* # of CPUs in cpus[]. */
+
+/* Set once other CPUs may be running.  Until then, every call to
+   cpu_current() is from the first CPU, possibly before
+   thread_init() has made it possible to find the running
+   thread. */
+static bool smp;
+
+/* The big kernel lock.  See the comment at the top of this
+   file.  Unlike other spinlocks, it stays held while interrupts
+   are on: an interrupt handler finds that its CPU holds it
+   already and goes ahead. */
+static struct spinlock kernel_spin = { 1 };
+
+/* MP floating pointer structure.  See [MP] 4.1 "MP Floating
+   Pointer Structure". */
+struct mp_fps
+  {
+    char signature[4];          /* "_MP_". */
+    uint32_t config;            /* Physical address of struct mp_config. */
+    uint8_t length;             /* Size in 16-byte units. */
+    uint8_t spec_rev;           /* Version of [MP]. */
+    uint8_t checksum;           /* Makes all the bytes sum to 0. */
+    uint8_t type;               /* Default configuration, if nonzero. */
+    uint8_t features[4];        /* Feature flags. */
+  }
+PACKED;
+
+/* MP configuration table header.  See [MP] 4.2 "MP Configuration
+   Table Header". */
+struct mp_config
+  {
+    char signature[4];          /* "PCMP". */
+    uint16_t length;            /* Bytes in table, with header. */
+    uint8_t spec_rev;           /* Version of [MP]. */
+    uint8_t checksum;           /* Makes all the bytes sum to 0. */
+    char oem_id[8];             /* Manufacturer. */
+    char product_id[12];        /* Product family. */
+    uint32_t oem_table;         /* Physical address of OEM table. */
+    uint16_t oem_length;        /* Bytes in OEM table. */
+    uint16_t entry_cnt;         /* # of entries after the header. */
+    uint32_t lapic_addr;        /* Physical address of local APICs. */
+    uint16_t ext_length;        /* Bytes in extended table. */
+    uint8_t ext_checksum;       /* Checksum of extended table. */
+    uint8_t reserved;
+  }
+PACKED;
+
+/* MP configuration table processor entry, the only kind of entry
+   we use.  All other entries are MP_ENTRY_SIZE bytes.  See [MP]
+   4.3.1 "Processor Entries". */
+#define MP_PROC 0               /* Type of a processor entry. */
+#define MP_ENTRY_SIZE 8         /* Size of every other entry. */
+struct mp_proc
+  {
+    uint8_t type;               /* MP_PROC. */
+    uint8_t apic_id;            /* Local APIC ID. */
+    uint8_t apic_version;       /* Local APIC version. */
+    uint8_t flags;              /* MP_PROC_* flags. */
+    uint32_t signature;         /* CPU type. */
+    uint32_t features;          /* CPUID feature flags. */
+    uint32_t reserved[2];
+  }
+PACKED;
+
+#define MP_PROC_ENABLED 0x01    /* Usable. */
+
+/* Startup code for other CPUs, in start.S, and the variables in
+   it that tell each one its page directory and stack. */
+extern uint8_t ap_start[], ap_start_end[];
+extern uint32_t ap_start_cr3, ap_start_esp;
+
+/* GDTR and IDTR for other CPUs to load, saved from the first
+   CPU. */
+static uint64_t gdtr_operand;
+static uint64_t idtr_operand;
+
+static struct mp_config *mp_find_config (void);
+static void tick_interrupt (struct intr_frame *);
+static void kick_interrupt (struct intr_frame *);
+
+/* Finds the CPUs listed in the MP configuration table and, if
+   there is more than one, maps the local APICs and enables the
+   first CPU's.  Must be called after paging_init() but before
+   any process page directory is created. */
+void
+cpu_init (void)
+{
+  struct mp_config *config = mp_find_config ();
+  uint8_t apic_ids[CPU_MAX];
+  uint8_t *p;
+  int cnt, i;
+
+  if (config == NULL)
+    return;
+
+  /* Collect the enabled CPUs' local APIC IDs. */
+  cnt = 0;
+  p = (uint8_t *) (config + 1);
+  for (i = 0; i < config->entry_cnt
+              && p < (uint8_t *) config + config->length; i++)
+    if (*p == MP_PROC)
+      {
+        struct mp_proc *proc = (struct mp_proc *) p;
+        if ((proc->flags & MP_PROC_ENABLED) && cnt < CPU_MAX)
+          apic_ids[cnt++] = proc->apic_id;
+        p += sizeof *proc;
+      }
+    else
+      p += MP_ENTRY_SIZE;
+  if (cnt < 2)
+    return;
+
+  lapic_map (config->lapic_addr);
+  lapic_init ();
+  cpus[0].apic_id = lapic_id ();
+  for (i = 0; i < cnt; i++)
+    if (apic_ids[i] != cpus[0].apic_id && cpu_cnt < CPU_MAX)
+      {
+        struct cpu *cpu = &cpus[cpu_cnt];
+        cpu->id = cpu_cnt++;
+        cpu->apic_id = apic_ids[i];
+      }
+}
+
+/* Returns the address of VAR, which lies between ap_start and
+   ap_start_end in start.S, within the copy of that code at
+   LOADER_AP_START. */
+static uint32_t *
+ap_start_var (uint32_t *var)
+{
+  return ptov (LOADER_AP_START + ((uint8_t *) var - ap_start));
+}
+
+/* Starts every CPU found by cpu_init() other than the running
+   one.  Each begins running its idle thread, and from then on
+   takes part in scheduling.  Must be called after the timer is
+   calibrated. */
+void
+cpu_start_aps (void)
+{
+  uint32_t *pd;
+  int i;
+
+  if (cpu_cnt < 2)
+    return;
+
+  intr_register_ipi (TICK_VEC, tick_interrupt, "CPU Tick");
+  intr_register_ipi (KICK_VEC, kick_interrupt, "CPU Kick");
+  asm volatile ("sgdt %0" : "=m" (gdtr_operand));
+  asm volatile ("sidt %0" : "=m" (idtr_operand));
+
+  /* The startup code turns on paging while running at its
+     physical address, so it needs a page directory that maps
+     the first 4 MB at address 0 as well as at PHYS_BASE. */
+  pd = palloc_get_page (PAL_ASSERT);
+  memcpy (pd, init_page_dir, PGSIZE);
+  pd[0] = pd[pd_no (PHYS_BASE)];
+
+  memcpy (ptov (LOADER_AP_START), ap_start, ap_start_end - ap_start);
+  *ap_start_var (&ap_start_cr3) = vtop (pd);
+
+  smp = true;
+  for (i = 1; i < cpu_cnt; i++)
+    {
+      struct cpu *cpu = &cpus[i];
+      struct thread *idle = thread_init_cpu (cpu);
+      int wait;
+
+      if (idle == NULL)
+        break;
+      *ap_start_var (&ap_start_esp) = (uint32_t) idle + PGSIZE;
+      lapic_start_ap (cpu->apic_id, LOADER_AP_START);
+
+      /* Wait up to 100 ms.  A CPU that starts after we give up
+         would find the next CPU's stack in ap_start_esp, so
+         stop there. */
+      for (wait = 0; !cpu->started && wait < 1000; wait++)
+        timer_udelay (100);
+      if (!cpu->started)
+        break;
+    }
+
+  printf ("%d of %d CPUs started.\n", i, cpu_cnt);
+  if (i == cpu_cnt)
+    palloc_free_page (pd);
+}
+
+/* Entered by each other CPU from the startup code in start.S, on
+   the stack of its idle thread.  Finishes setting up the CPU and
+   starts scheduling. */
+void
+cpu_ap_main (void)
+{
+  /* Switch to the kernel page directory and descriptor tables,
+     away from the startup code's copies in low memory. */
+  asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
+  asm volatile ("lgdt %0" : : "m" (gdtr_operand));
+  asm volatile ("lidt %0" : : "m" (idtr_operand));
+#ifdef USERPROG
+  gdt_load ();
+#endif
+  lapic_init ();
+
+  cpu_current ()->started = true;
+  kernel_lock ();
+  thread_start_cpu ();
+}
+
+/* Returns the running CPU.  Interrupts should be off, or the
+   running thread may move to another CPU at any time. */
+struct cpu *
+cpu_current (void)
+{
+  struct thread *t;
+  uint32_t *esp;
+
+  if (!smp)
+    return &cpus[0];
+
+  /* Find the running thread as running_thread() in thread.c
+     does, which is not safe to call until thread_init(). */
+  asm ("mov %%esp, %0" : "=g" (esp));
+  t = pg_round_down (esp);
+  return t->cpu;
+}
+
+/* Interrupts CPU so that it reconsiders which thread to run. */
+void
+cpu_kick (struct cpu *cpu)
+{
+  ASSERT (cpu != cpu_current ());
+  lapic_send_ipi (cpu->apic_id, KICK_VEC);
+}
+
+/* Passes the timer tick on to the other CPUs.  Called by the
+   timer interrupt handler on the first CPU. */
+void
+cpu_tick_others (void)
+{
+  if (smp)
+    lapic_send_ipi_others (TICK_VEC);
+}
+
+/* Timer tick IPI handler. */
+static void
+tick_interrupt (struct intr_frame *args UNUSED)
+{
+  thread_tick ();
+}
+
+/* Kick IPI handler. */
+static void
+kick_interrupt (struct intr_frame *args UNUSED)
+{
+  thread_preempt ();
+}
+
+/* Acquires the big kernel lock for the running CPU, spinning
+   until it is free.  Interrupts must be off. */
+void
+kernel_lock (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (!kernel_locked ());
+
+  spin_lock (&kernel_spin);
+  cpu_current ()->kernel_locked = true;
+}
+
+/* Releases the big kernel lock, which the running CPU must
+   hold.  Interrupts must be off. */
+void
+kernel_unlock (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (kernel_locked ());
+
+  cpu_current ()->kernel_locked = false;
+  spin_unlock (&kernel_spin);
+}
+
+/* Returns true if the running CPU holds the big kernel lock. */
+bool
+kernel_locked (void)
+{
+  return cpu_current ()->kernel_locked;
+}
+
+/* Returns the sum of the SIZE bytes at P, which is 0 for a valid
+   MP structure. */
+static uint8_t
+checksum (const void *p_, size_t size)
+{
+  const uint8_t *p = p_;
+  uint8_t sum = 0;
+
+  while (size-- > 0)
+    sum += *p++;
+  return sum;
+}
+
+/* Returns the MP floating pointer structure in the SIZE bytes at
+   physical address PADDR, or a null pointer if there is none. */
+static struct mp_fps *
+mp_search (uintptr_t paddr, size_t size)
+{
+  uint8_t *p = ptov (paddr);
+  uint8_t *end = p + size;
+
+  /* See [MP] 4 "MP Configuration Table": the structure is
+     16-byte aligned. */
+  for (; p + sizeof (struct mp_fps) <= end; p += 16)
+    if (!memcmp (p, "_MP_", 4) && checksum (p, sizeof (struct mp_fps)) == 0)
+      return (struct mp_fps *) p;
+  return NULL;
+}
+
+/* Returns the MP configuration table, or a null pointer if there
+   is none or it is not usable.  The MP floating pointer
+   structure that points to it is in the first kB of the
+   extended BIOS data area, the last kB of base memory, or the
+   BIOS ROM, in that order.  See [MP] 4 "MP Configuration
+   Table". */
+static struct mp_config *
+mp_find_config (void)
+{
+  uint16_t ebda_seg = *(uint16_t *) ptov (0x40e);
+  uint16_t base_kb = *(uint16_t *) ptov (0x413);
+  uintptr_t ram_size = init_ram_pages * PGSIZE;
+  struct mp_fps *fps = NULL;
+  struct mp_config *config;
+
+  if (ebda_seg != 0)
+    fps = mp_search ((uintptr_t) ebda_seg << 4, 1024);
+  if (fps == NULL && base_kb >= 1)
+    fps = mp_search ((uintptr_t) (base_kb - 1) * 1024, 1024);
+  if (fps == NULL)
+    fps = mp_search (0xf0000, 0x10000);
+
+  /* A default configuration has no table.  We only bother with
+     tables in RAM that is mapped. */
+  if (fps == NULL || fps->config == 0
+      || fps->config + sizeof *config > ram_size)
+    return NULL;
+  config = ptov (fps->config);
+  if (memcmp (config->signature, "PCMP", 4)
+      || fps->config + config->length > ram_size
+      || checksum (config, config->length) != 0)
+    return NULL;
+  return config;
+}
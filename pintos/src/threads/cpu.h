@@ -0,0 +1,48 @@
+#ifndef THREADS_CPU_H
+#define THREADS_CPU_H
+
+#include <debug.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Most CPUs that Pintos will use. */
+#define CPU_MAX 8
+
+/* A CPU.
+
+   cpus[0] is the bootstrap processor (BSP), the CPU that runs
+   main().  The others are application processors (APs), started
+   by cpu_start_aps(). */
+struct cpu
+  {
+    int id;                     /* Index in cpus[]. */
+    uint8_t apic_id;            /* Local APIC ID. */
+    volatile bool started;      /* Running the scheduler yet? */
+    bool kernel_locked;         /* Holds the big kernel lock? */
+
+    /* Owned by thread.c, protected by its scheduler lock. */
+    struct thread *cur;         /* Running thread. */
+    struct thread *idle;        /* Idle thread. */
+    unsigned thread_ticks;      /* # of timer ticks since last yield. */
+
+    /* Owned by interrupt.c. */
+    bool in_external_intr;      /* Processing an external interrupt? */
+    bool yield_on_return;       /* Should we yield on interrupt return? */
+  };
+
+extern struct cpu cpus[CPU_MAX];
+extern int cpu_cnt;
+
+void cpu_init (void);
+void cpu_start_aps (void);
+void cpu_ap_main (void) NO_RETURN;
+
+struct cpu *cpu_current (void);
+void cpu_kick (struct cpu *);
+void cpu_tick_others (void);
+
+void kernel_lock (void);
+void kernel_unlock (void);
+bool kernel_locked (void);
+
+#endif /* threads/cpu.h */
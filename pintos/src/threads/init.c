@@ -12,16 +12,19 @@
 #include "devices/input.h"
 #include "devices/serial.h"
 #include "devices/shutdown.h"
+#include "devices/timeout.h"
 #include "devices/timer.h"
 #include "devices/vga.h"
 #include "devices/rtc.h"
 #include "filesys/directory.h"
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/process.h"
@@ -35,8 +38,10 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/inode.h"
 #endif
 
 /* Page directory with kernel mappings only. */
@@ -99,6 +104,7 @@ main (void)
   palloc_init (user_page_limit);
   malloc_init ();
   paging_init ();
+  cpu_init ();
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -118,8 +124,10 @@ main (void)
 
   /* Start thread scheduler and enable interrupts. */
   thread_start ();
+  timeout_start ();
   serial_init_queue ();
   timer_calibrate ();
+  cpu_start_aps ();
 
 #ifdef FILESYS
   /* Initialize file system. */
@@ -249,6 +257,40 @@ parse_options (char **argv)
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-cache"))
+        cache_set_size (atoi (value));
+      else if (!strcmp (name, "-cache-max"))
+        cache_set_max_size (atoi (value));
+      else if (!strcmp (name, "-cache-block"))
+        {
+          if (value == NULL || !cache_set_block_size (atoi (value)))
+            PANIC ("bad cache block size `%s' (use -h for help)",
+                   value != NULL ? value : "");
+        }
+      else if (!strcmp (name, "-inode-map"))
+        {
+          if (value != NULL && !strcmp (value, "extents"))
+            inode_use_extents (true);
+          else if (value != NULL && !strcmp (value, "blocks"))
+            inode_use_extents (false);
+          else
+            PANIC ("unknown inode map `%s' (use -h for help)",
+                   value != NULL ? value : "");
+        }
+      else if (!strcmp (name, "-delay-alloc"))
+        inode_delay_alloc (true);
+      else if (!strcmp (name, "-flush-interval"))
+        cache_set_flush_interval (atoi (value));
+      else if (!strcmp (name, "-dirty-ratio"))
+        cache_set_dirty_ratio (atoi (value));
+      else if (!strcmp (name, "-cache-meta"))
+        cache_set_meta_reserve (atoi (value));
+      else if (!strcmp (name, "-cache-policy"))
+        {
+          if (value == NULL || !cache_set_policy (value))
+            PANIC ("unknown cache policy `%s' (use -h for help)",
+                   value != NULL ? value : "");
+        }
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
@@ -258,6 +300,8 @@ parse_options (char **argv)
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-lockstat"))
+        lock_stat_enabled = true;
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
@@ -317,6 +361,7 @@ run_actions (char **argv)
       {"rm", 2, fsutil_rm},
       {"extract", 1, fsutil_extract},
       {"append", 2, fsutil_append},
+      {"frag", 1, fsutil_frag},
 #endif
       {NULL, 0, NULL},
     };
@@ -363,6 +408,7 @@ usage (void)
           "  ls                 List files in the root directory.\n"
           "  cat FILE           Print FILE to the console.\n"
           "  rm FILE            Delete FILE.\n"
+          "  frag               Report free space and file fragmentation.\n"
           "Use these actions indirectly via `pintos' -g and -p options:\n"
           "  extract            Untar from scratch device into file system.\n"
           "  append FILE        Append FILE to tar file on scratch device.\n"
@@ -375,12 +421,22 @@ usage (void)
           "  -f                 Format file system device during startup.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -cache=SECTORS     Set buffer cache size (default 64).\n"
+          "  -cache-max=SECTORS Let buffer cache grow up to SECTORS.\n"
+          "  -cache-block=N     Cache blocks of N sectors: 1 (default), 2, 4, or 8.\n"
+          "  -inode-map=KIND    Map new files by extents (default) or blocks.\n"
+          "  -delay-alloc       Allocate sectors for file data when written back.\n"
+          "  -flush-interval=MS Write back expired dirty blocks every MS ms.\n"
+          "  -dirty-ratio=PCT   Write back all dirty blocks above PCT%% dirty.\n"
+          "  -cache-policy=NAME Use clock (default), lru, 2q, or arc replacement.\n"
+          "  -cache-meta=PCT    Reserve PCT%% for metadata (default 25, max 50).\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -lockstat          Print lock contention statistics at shutdown.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
 #endif
@@ -3,6 +3,8 @@
 #include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
+#include "devices/lapic.h"
+#include "threads/cpu.h"
 #include "threads/flags.h"
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
@@ -38,14 +40,13 @@ static const char *intr_names[INTR_CNT];
 static unsigned int unexpected_cnt[INTR_CNT];
 
 /* External interrupts are those generated by devices outside the
-   CPU, such as the timer.  External interrupts run with
-   interrupts turned off, so they never nest, nor are they ever
-   pre-empted.  Handlers for external interrupts also may not
-   sleep, although they may invoke intr_yield_on_return() to
-   request that a new process be scheduled just before the
-   interrupt returns. */
-static bool in_external_intr;   /* Are we processing an external interrupt? */
-static bool yield_on_return;    /* Should we yield on interrupt return? */
+   CPU, such as the timer, and IPIs from other CPUs.  External
+   interrupts run with interrupts turned off, so they never nest,
+   nor are they ever pre-empted.  Handlers for external
+   interrupts also may not sleep, although they may invoke
+   intr_yield_on_return() to request that a new process be
+   scheduled just before the interrupt returns.  Each CPU tracks
+   whether it is processing one in its struct cpu. */
 
 /* Programmable Interrupt Controller helpers. */
 static void pic_init (void);
@@ -58,6 +59,7 @@ static inline uint64_t make_idtr_operand (uint16_t limit, void *base);
 
 /* Interrupt handlers. */
 void intr_handler (struct intr_frame *args);
+static bool is_external (uint8_t vec_no);
 static void unexpected_interrupt (const struct intr_frame *);
 
 /* Returns the current interrupt status. */
@@ -185,6 +187,18 @@ intr_register_ext (uint8_t vec_no, intr_handler_func *handler,
   register_handler (vec_no, 0, INTR_OFF, handler, name);
 }
 
+/* Registers VEC_NO, which must be in 0xf0...0xfe, to invoke
+   HANDLER for IPIs sent by other CPUs through their local APICs.
+   IPIs are external interrupts, so HANDLER is named NAME for
+   debugging purposes and executes with interrupts disabled. */
+void
+intr_register_ipi (uint8_t vec_no, intr_handler_func *handler,
+                   const char *name)
+{
+  ASSERT (vec_no >= 0xf0 && vec_no < LAPIC_SPURIOUS);
+  register_handler (vec_no, 0, INTR_OFF, handler, name);
+}
+
 /* Registers internal interrupt VEC_NO to invoke HANDLER, which
    is named NAME for debugging purposes.  The interrupt handler
    will be invoked with interrupt status LEVEL.
@@ -202,7 +216,7 @@ void
 intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
                    intr_handler_func *handler, const char *name)
 {
-  ASSERT (vec_no < 0x20 || vec_no > 0x2f);
+  ASSERT (!is_external (vec_no));
   register_handler (vec_no, dpl, level, handler, name);
 }
 
@@ -211,7 +225,11 @@ intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
 bool
 intr_context (void)
 {
-  return in_external_intr;
+  /* External interrupt handlers run with interrupts off, which
+     also keeps us on the same CPU while we check. */
+  if (intr_get_level () == INTR_ON)
+    return false;
+  return cpu_current ()->in_external_intr;
 }
 
 /* During processing of an external interrupt, directs the
@@ -222,7 +240,7 @@ void
 intr_yield_on_return (void)
 {
   ASSERT (intr_context ());
-  yield_on_return = true;
+  cpu_current ()->yield_on_return = true;
 }
 
 /* 8259A Programmable Interrupt Controller. */
@@ -344,28 +362,43 @@ make_idtr_operand (uint16_t limit, void *base)
 void
 intr_handler (struct intr_frame *frame)
 {
-  bool external;
+  bool external, locked = false;
   intr_handler_func *handler;
+  enum intr_level old_level;
+
+  /* Take the big kernel lock, unless we interrupted kernel code
+     that holds it already.  We don't hold it if we interrupted
+     user code or the idle loop waiting for an interrupt. */
+  old_level = intr_disable ();
+  if (!kernel_locked ())
+    {
+      kernel_lock ();
+      locked = true;
+    }
+  intr_set_level (old_level);
 
   /* External interrupts are special.
      We only handle one at a time (so interrupts must be off)
-     and they need to be acknowledged on the PIC (see below).
-     An external interrupt handler cannot sleep. */
-  external = frame->vec_no >= 0x20 && frame->vec_no < 0x30;
+     and they need to be acknowledged on the PIC or local APIC
+     (see below).  An external interrupt handler cannot sleep. */
+  external = is_external (frame->vec_no);
   if (external)
     {
+      struct cpu *cpu = cpu_current ();
+
       ASSERT (intr_get_level () == INTR_OFF);
       ASSERT (!intr_context ());
 
-      in_external_intr = true;
-      yield_on_return = false;
+      cpu->in_external_intr = true;
+      cpu->yield_on_return = false;
     }
 
   /* Invoke the interrupt's handler. */
   handler = intr_handlers[frame->vec_no];
   if (handler != NULL)
     handler (frame);
-  else if (frame->vec_no == 0x27 || frame->vec_no == 0x2f)
+  else if (frame->vec_no == 0x27 || frame->vec_no == 0x2f
+           || frame->vec_no == LAPIC_SPURIOUS)
     {
       /* There is no handler, but this interrupt can trigger
          spuriously due to a hardware fault or hardware race
@@ -377,15 +410,37 @@ intr_handler (struct intr_frame *frame)
   /* Complete the processing of an external interrupt. */
   if (external)
     {
+      struct cpu *cpu = cpu_current ();
+
       ASSERT (intr_get_level () == INTR_OFF);
       ASSERT (intr_context ());
 
-      in_external_intr = false;
-      pic_end_of_interrupt (frame->vec_no);
+      cpu->in_external_intr = false;
+      if (frame->vec_no < 0x30)
+        pic_end_of_interrupt (frame->vec_no);
+      else if (frame->vec_no != LAPIC_SPURIOUS)
+        lapic_eoi ();
 
-      if (yield_on_return)
+      if (cpu->yield_on_return)
         thread_yield ();
     }
+
+  /* Let other CPUs into the kernel again if we are returning to
+     user code or the idle loop.  We may be on a different CPU by
+     now, if we yielded above. */
+  if (locked)
+    {
+      intr_disable ();
+      kernel_unlock ();
+    }
+}
+
+/* Returns true if VEC_NO is an external interrupt: one from the
+   PICs, or an IPI. */
+static bool
+is_external (uint8_t vec_no)
+{
+  return (vec_no >= 0x20 && vec_no < 0x30) || vec_no >= 0xf0;
 }
 
 /* Handles an unexpected interrupt with interrupt frame F.  An
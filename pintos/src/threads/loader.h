@@ -18,6 +18,12 @@
 #define LOADER_ARGS (LOADER_PARTS - LOADER_ARGS_LEN)   /* Command-line args. */
 #define LOADER_ARG_CNT (LOADER_ARGS - LOADER_ARG_CNT_LEN) /* Number of args. */
 
+/* Physical address to which cpu_start_aps() copies the startup
+   code for other CPUs, ap_start in start.S.  Other CPUs begin
+   executing there in real mode, so it must be page-aligned and
+   below 1 MB. */
+#define LOADER_AP_START 0x7000
+
 /* Sizes of loader data structures. */
 #define LOADER_SIG_LEN 2
 #define LOADER_PARTS_LEN 64
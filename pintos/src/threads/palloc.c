@@ -8,6 +8,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/loader.h"
+#include "threads/spinlock.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 
@@ -31,6 +32,11 @@ struct pool
     struct lock lock;                   /* Mutual exclusion. */
     struct bitmap *used_map;            /* Bitmap of free pages. */
     uint8_t *base;                      /* Base of pool. */
+    size_t free_cnt;                    /* Number of free pages. */
+    struct spinlock cnt_lock;           /* Protects FREE_CNT.  Pages
+                                           may be freed with interrupts
+                                           off, where LOCK can't be
+                                           taken. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -39,6 +45,7 @@ static struct pool kernel_pool, user_pool;
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static void adjust_free_cnt (struct pool *, size_t add, size_t sub);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -82,7 +89,10 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   lock_release (&pool->lock);
 
   if (page_idx != BITMAP_ERROR)
-    pages = pool->base + PGSIZE * page_idx;
+    {
+      pages = pool->base + PGSIZE * page_idx;
+      adjust_free_cnt (pool, 0, page_cnt);
+    }
   else
     pages = NULL;
 
@@ -139,6 +149,7 @@ palloc_free_multiple (void *pages, size_t page_cnt)
 
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
   bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  adjust_free_cnt (pool, page_cnt, 0);
 }
 
 /* Frees the page at PAGE. */
@@ -148,6 +159,33 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Returns the number of free pages in the user pool if PAL_USER
+   is set in FLAGS, otherwise in the kernel pool.  Takes constant
+   time, so that it can be called on every cache miss. */
+size_t
+palloc_free_cnt (enum palloc_flags flags)
+{
+  struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  enum intr_level old_level;
+  size_t cnt;
+
+  old_level = spin_lock_irqsave (&pool->cnt_lock);
+  cnt = pool->free_cnt;
+  spin_unlock_irqrestore (&pool->cnt_lock, old_level);
+
+  return cnt;
+}
+
+/* Adds ADD to, and subtracts SUB from, POOL's count of free
+   pages. */
+static void
+adjust_free_cnt (struct pool *pool, size_t add, size_t sub)
+{
+  enum intr_level old_level = spin_lock_irqsave (&pool->cnt_lock);
+  pool->free_cnt = pool->free_cnt + add - sub;
+  spin_unlock_irqrestore (&pool->cnt_lock, old_level);
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
@@ -165,8 +203,11 @@ init_pool (struct pool *p, void *base, size_t page_cnt, const char *name)
 
   /* Initialize the pool. */
   lock_init (&p->lock);
+  lock_set_name (&p->lock, name);
   p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
   p->base = base + bm_pages * PGSIZE;
+  p->free_cnt = page_cnt;
+  spin_init (&p->cnt_lock);
 }
 
 /* Returns true if PAGE was allocated from POOL,
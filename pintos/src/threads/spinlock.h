@@ -0,0 +1,87 @@
+#ifndef THREADS_SPINLOCK_H
+#define THREADS_SPINLOCK_H
+
+#include <debug.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+
+/* Spinlock.
+
+   Protects a short critical section that must not sleep, such
+   as the internals of a semaphore.  A spinlock may only be held
+   with interrupts off, so that an interrupt handler on the same
+   CPU can never spin on a lock its own CPU holds.
+
+   Turning interrupts off only excludes other code on the same
+   CPU; the atomic exchange below excludes the other CPUs.  A
+   thread that sleeps on a list protected by a spinlock must hand
+   the lock to the scheduler with thread_block_unlock().
+   Spinlocks do not nest recursively: that would spin forever. */
+struct spinlock
+  {
+    volatile uint32_t locked;   /* Nonzero while held. */
+  };
+
+/* Initializer for a spinlock that is not held. */
+#define SPINLOCK_INITIALIZER { 0 }
+
+/* Initializes LOCK as not held. */
+static inline void
+spin_init (struct spinlock *lock)
+{
+  lock->locked = 0;
+}
+
+/* Atomically sets LOCK as held and returns its previous state. */
+static inline uint32_t
+spin_xchg (struct spinlock *lock)
+{
+  /* See [IA32-v2b] "XCHG".  XCHG with a memory operand is
+     always locked. */
+  uint32_t old = 1;
+  asm volatile ("xchgl %0, %1" : "+r" (old), "+m" (lock->locked)
+                : : "memory");
+  return old;
+}
+
+/* Acquires LOCK, spinning until it is free.  Interrupts must be
+   off. */
+static inline void
+spin_lock (struct spinlock *lock)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (spin_xchg (lock) != 0)
+    asm volatile ("pause");
+}
+
+/* Releases LOCK, which must be held.  Interrupts must be off. */
+static inline void
+spin_unlock (struct spinlock *lock)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (lock->locked != 0);
+
+  asm volatile ("" : : : "memory");
+  lock->locked = 0;
+}
+
+/* Turns interrupts off, acquires LOCK, and returns the previous
+   interrupt level, to be passed to spin_unlock_irqrestore(). */
+static inline enum intr_level
+spin_lock_irqsave (struct spinlock *lock)
+{
+  enum intr_level old_level = intr_disable ();
+  spin_lock (lock);
+  return old_level;
+}
+
+/* Releases LOCK and restores interrupt level OLD_LEVEL. */
+static inline void
+spin_unlock_irqrestore (struct spinlock *lock, enum intr_level old_level)
+{
+  spin_unlock (lock);
+  intr_set_level (old_level);
+}
+
+#endif /* threads/spinlock.h */
@@ -29,6 +29,8 @@
 #include "threads/synch.h"
 #include <stdio.h>
 #include <string.h>
+#include "devices/timeout.h"
+#include "devices/timer.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 
@@ -46,8 +48,112 @@ sema_init (struct semaphore *sema, unsigned value)
 {
   ASSERT (sema != NULL);
 
+  spin_init (&sema->spin);
   sema->value = value;
   list_init (&sema->waiters);
+  sema->stat = NULL;
+}
+
+/* Lock contention statistics, one entry per distinct name. */
+#define LOCK_STAT_CNT 32
+static struct lock_stat lock_stats[LOCK_STAT_CNT];
+static size_t lock_stat_cnt;
+
+bool lock_stat_enabled;
+
+/* Returns the statistics entry for NAME, creating it if
+   necessary, or a null pointer if the table is full. */
+static struct lock_stat *
+lock_stat_lookup (const char *name)
+{
+  struct lock_stat *stat = NULL;
+  enum intr_level old_level;
+  size_t i;
+
+  old_level = intr_disable ();
+  for (i = 0; i < lock_stat_cnt; i++)
+    if (!strcmp (lock_stats[i].name, name))
+      {
+        stat = &lock_stats[i];
+        break;
+      }
+  if (stat == NULL && lock_stat_cnt < LOCK_STAT_CNT)
+    {
+      stat = &lock_stats[lock_stat_cnt++];
+      stat->name = name;
+    }
+  intr_set_level (old_level);
+
+  return stat;
+}
+
+/* Gives SEMA the name NAME, which must remain valid for the
+   lifetime of the kernel, for the purpose of contention
+   statistics.  Semaphores sharing a name share statistics. */
+void
+sema_set_name (struct semaphore *sema, const char *name)
+{
+  ASSERT (sema != NULL);
+  ASSERT (name != NULL);
+
+  sema->stat = lock_stat_lookup (name);
+}
+
+/* Records a successful down of SEMA.  If CONTENDED, the caller
+   had to wait, starting at tick START.  Interrupts must be
+   off. */
+static void
+sema_record_acquire (struct semaphore *sema, bool contended, int64_t start)
+{
+  struct lock_stat *stat = sema->stat;
+
+  if (!lock_stat_enabled || stat == NULL)
+    return;
+
+  stat->acquires++;
+  if (contended)
+    {
+      int64_t wait = timer_ticks () - start;
+      stat->contended++;
+      stat->wait_ticks += wait;
+      if (wait > stat->max_wait)
+        stat->max_wait = wait;
+    }
+}
+
+/* Prints the statistics of every named lock and semaphore,
+   most waited-on first, if "-lockstat" was given. */
+void
+lock_print_stats (void)
+{
+  struct lock_stat *order[LOCK_STAT_CNT];
+  size_t i, j;
+
+  if (!lock_stat_enabled)
+    return;
+
+  /* Insertion sort by total wait, then by contended count. */
+  for (i = 0; i < lock_stat_cnt; i++)
+    {
+      struct lock_stat *stat = &lock_stats[i];
+      for (j = i; j > 0; j--)
+        {
+          struct lock_stat *prev = order[j - 1];
+          if (prev->wait_ticks > stat->wait_ticks
+              || (prev->wait_ticks == stat->wait_ticks
+                  && prev->contended >= stat->contended))
+            break;
+          order[j] = prev;
+        }
+      order[j] = stat;
+    }
+
+  printf ("Locks: %-16s %10s %10s %10s %8s %8s\n", "name", "acquires",
+          "contended", "wait", "max wait", "max hold");
+  for (i = 0; i < lock_stat_cnt; i++)
+    printf ("Locks: %-16s %10u %10u %10lld %8lld %8lld\n",
+            order[i]->name, order[i]->acquires, order[i]->contended,
+            order[i]->wait_ticks, order[i]->max_wait, order[i]->max_hold);
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -61,18 +167,104 @@ void
 sema_down (struct semaphore *sema)
 {
   enum intr_level old_level;
+  bool contended;
+  int64_t start = 0;
 
   ASSERT (sema != NULL);
   ASSERT (!intr_context ());
 
-  old_level = intr_disable ();
+  old_level = spin_lock_irqsave (&sema->spin);
+  contended = sema->value == 0;
+  if (contended && lock_stat_enabled && sema->stat != NULL)
+    start = timer_ticks ();
   while (sema->value == 0)
     {
+      /* SEMA's spinlock is released only once we are blocked, so
+         that sema_up() on another CPU cannot wake us first. */
       list_push_back (&sema->waiters, &thread_current ()->elem);
-      thread_block ();
+      thread_block_unlock (&sema->spin);
+      spin_lock (&sema->spin);
     }
   sema->value--;
+  sema_record_acquire (sema, contended, start);
+  spin_unlock_irqrestore (&sema->spin, old_level);
+}
+
+/* A thread waiting in sema_down_timeout(). */
+struct sema_timeout_waiter
+  {
+    struct semaphore *sema;             /* Semaphore waited on. */
+    struct thread *thread;              /* Waiting thread. */
+    bool expired;                       /* Has the timeout fired? */
+  };
+
+/* Timeout function for sema_down_timeout().  Runs in the timer
+   interrupt handler.  If the waiter is still blocked, then it is
+   still on the semaphore's wait list, so take it off and wake
+   it up. */
+static void
+sema_timeout_expired (void *waiter_)
+{
+  struct sema_timeout_waiter *waiter = waiter_;
+
+  spin_lock (&waiter->sema->spin);
+  waiter->expired = true;
+  if (waiter->thread->status == THREAD_BLOCKED)
+    {
+      list_remove (&waiter->thread->elem);
+      thread_unblock (waiter->thread);
+    }
+  spin_unlock (&waiter->sema->spin);
+}
+
+/* Down or "P" operation on a semaphore that gives up after
+   TICKS timer ticks.  Returns true if SEMA was decremented,
+   false if the timeout expired first.  A non-positive TICKS
+   behaves like sema_try_down().
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+bool
+sema_down_timeout (struct semaphore *sema, int64_t ticks)
+{
+  struct sema_timeout_waiter waiter;
+  struct timeout timeout;
+  enum intr_level old_level;
+  bool success, contended;
+  int64_t start;
+
+  ASSERT (sema != NULL);
+  ASSERT (!intr_context ());
+
+  if (ticks <= 0)
+    return sema_try_down (sema);
+
+  waiter.sema = sema;
+  waiter.thread = thread_current ();
+  waiter.expired = false;
+  timeout_init (&timeout, sema_timeout_expired, &waiter, false);
+
+  old_level = spin_lock_irqsave (&sema->spin);
+  contended = sema->value == 0;
+  start = timer_ticks ();
+  timeout_arm (&timeout, ticks);
+  while (sema->value == 0 && !waiter.expired)
+    {
+      list_push_back (&sema->waiters, &thread_current ()->elem);
+      thread_block_unlock (&sema->spin);
+      spin_lock (&sema->spin);
+    }
+  success = sema->value > 0;
+  if (success)
+    {
+      sema->value--;
+      sema_record_acquire (sema, contended, start);
+    }
+  spin_unlock (&sema->spin);
+  timeout_cancel (&timeout);
   intr_set_level (old_level);
+
+  return success;
 }
 
 /* Down or "P" operation on a semaphore, but only if the
@@ -88,21 +280,34 @@ sema_try_down (struct semaphore *sema)
 
   ASSERT (sema != NULL);
 
-  old_level = intr_disable ();
+  old_level = spin_lock_irqsave (&sema->spin);
   if (sema->value > 0)
     {
       sema->value--;
       success = true;
+      sema_record_acquire (sema, false, 0);
     }
   else
     success = false;
-  intr_set_level (old_level);
+  spin_unlock_irqrestore (&sema->spin, old_level);
 
   return success;
 }
 
+/* Returns true if the thread owning A has a lower priority than
+   the thread owning B. */
+static bool
+thread_priority_less (const struct list_elem *a, const struct list_elem *b,
+                      void *aux UNUSED)
+{
+  return list_entry (a, struct thread, elem)->priority
+         < list_entry (b, struct thread, elem)->priority;
+}
+
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
-   and wakes up one thread of those waiting for SEMA, if any.
+   and wakes up the highest-priority thread of those waiting for
+   SEMA, if any, yielding to it if it has a higher priority than
+   the running thread.
 
    This function may be called from an interrupt handler. */
 void
@@ -112,12 +317,18 @@ sema_up (struct semaphore *sema)
 
   ASSERT (sema != NULL);
 
-  old_level = intr_disable ();
+  old_level = spin_lock_irqsave (&sema->spin);
   if (!list_empty (&sema->waiters))
-    thread_unblock (list_entry (list_pop_front (&sema->waiters),
-                                struct thread, elem));
+    {
+      struct list_elem *e = list_max (&sema->waiters,
+                                      thread_priority_less, NULL);
+      list_remove (e);
+      thread_unblock (list_entry (e, struct thread, elem));
+    }
   sema->value++;
-  intr_set_level (old_level);
+  spin_unlock_irqrestore (&sema->spin, old_level);
+
+  thread_preempt ();
 }
 
 static void sema_test_helper (void *sema_);
@@ -179,12 +390,74 @@ lock_init (struct lock *lock)
 
   lock->holder = NULL;
   sema_init (&lock->semaphore, 1);
+  lock->max_priority = PRI_MIN;
+  lock->acquired_at = 0;
+}
+
+/* Gives LOCK the name NAME for the purpose of contention
+   statistics.  See sema_set_name(). */
+void
+lock_set_name (struct lock *lock, const char *name)
+{
+  ASSERT (lock != NULL);
+
+  sema_set_name (&lock->semaphore, name);
+}
+
+/* Donates the running thread's priority along the chain of
+   locks starting at LOCK: to LOCK's holder, to the holder of the
+   lock that holder is waiting for, and so on.  Stops as soon as
+   a lock already carries at least that much priority, which also
+   keeps a deadlock cycle from looping forever.
+   Interrupts must be off. */
+static void
+donate_priority (struct lock *lock)
+{
+  int priority = thread_current ()->priority;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (lock != NULL && lock->holder != NULL
+         && lock->max_priority < priority)
+    {
+      lock->max_priority = priority;
+      thread_update_priority (lock->holder);
+      lock = lock->holder->waiting_lock;
+    }
+}
+
+/* Makes the running thread the holder of LOCK, which it has just
+   downed.  The threads still waiting for LOCK now donate to the
+   new holder.  Interrupts must be off. */
+static void
+lock_take (struct lock *lock)
+{
+  struct thread *cur = thread_current ();
+  struct list *waiters = &lock->semaphore.waiters;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  lock->holder = cur;
+  if (lock_stat_enabled && lock->semaphore.stat != NULL)
+    lock->acquired_at = timer_ticks ();
+  lock->max_priority = PRI_MIN;
+  if (!thread_mlfqs && !list_empty (waiters))
+    lock->max_priority = list_entry (list_max (waiters, thread_priority_less,
+                                               NULL),
+                                     struct thread, elem)->priority;
+  list_push_back (&cur->held_locks, &lock->elem);
+  if (!thread_mlfqs)
+    thread_update_priority (cur);
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
    thread.
 
+   While waiting, the current thread donates its priority to the
+   holder of LOCK and, transitively, to whichever threads that
+   holder is itself waiting on.
+
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
@@ -192,12 +465,23 @@ lock_init (struct lock *lock)
 void
 lock_acquire (struct lock *lock)
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
+  if (lock->holder != NULL && !thread_mlfqs)
+    {
+      cur->waiting_lock = lock;
+      donate_priority (lock);
+    }
   sema_down (&lock->semaphore);
-  lock->holder = thread_current ();
+  cur->waiting_lock = NULL;
+  lock_take (lock);
+  intr_set_level (old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -210,17 +494,22 @@ bool
 lock_try_acquire (struct lock *lock)
 {
   bool success = false;
+  enum intr_level old_level;
 
   ASSERT (lock != NULL);
   ASSERT (!lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    lock_take (lock);
+  intr_set_level (old_level);
   return success;
 }
 
 /* Releases LOCK, which must be owned by the current thread.
+   Priority donated through LOCK is given up, which only requires
+   looking at the other locks the current thread still holds.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
@@ -228,10 +517,26 @@ lock_try_acquire (struct lock *lock)
 void
 lock_release (struct lock *lock)
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
+  if (lock_stat_enabled && lock->semaphore.stat != NULL)
+    {
+      int64_t hold = timer_ticks () - lock->acquired_at;
+      if (hold > lock->semaphore.stat->max_hold)
+        lock->semaphore.stat->max_hold = hold;
+    }
+  list_remove (&lock->elem);
   lock->holder = NULL;
+  lock->max_priority = PRI_MIN;
+  if (!thread_mlfqs)
+    thread_update_priority (cur);
+  intr_set_level (old_level);
+
   sema_up (&lock->semaphore);
 }
 
@@ -251,8 +556,19 @@ struct semaphore_elem
   {
     struct list_elem elem;              /* List element. */
     struct semaphore semaphore;         /* This semaphore. */
+    struct thread *thread;              /* Thread waiting on it. */
   };
 
+/* Returns true if the thread waiting on semaphore_elem A has a
+   lower priority than the one waiting on semaphore_elem B. */
+static bool
+waiter_priority_less (const struct list_elem *a, const struct list_elem *b,
+                      void *aux UNUSED)
+{
+  return list_entry (a, struct semaphore_elem, elem)->thread->priority
+         < list_entry (b, struct semaphore_elem, elem)->thread->priority;
+}
+
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -295,15 +611,54 @@ cond_wait (struct condition *cond, struct lock *lock)
   ASSERT (lock_held_by_current_thread (lock));
 
   sema_init (&waiter.semaphore, 0);
+  waiter.thread = thread_current ();
   list_push_back (&cond->waiters, &waiter.elem);
   lock_release (lock);
   sema_down (&waiter.semaphore);
   lock_acquire (lock);
 }
 
+/* Like cond_wait(), but gives up waiting after TICKS timer
+   ticks.  LOCK is reacquired before returning in either case.
+   Returns true if COND was signaled, false if the timeout
+   expired first.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+bool
+cond_wait_timeout (struct condition *cond, struct lock *lock, int64_t ticks)
+{
+  struct semaphore_elem waiter;
+  bool signaled;
+
+  ASSERT (cond != NULL);
+  ASSERT (lock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (lock_held_by_current_thread (lock));
+
+  sema_init (&waiter.semaphore, 0);
+  waiter.thread = thread_current ();
+  list_push_back (&cond->waiters, &waiter.elem);
+  lock_release (lock);
+  signaled = sema_down_timeout (&waiter.semaphore, ticks);
+  lock_acquire (lock);
+
+  /* A signal may have arrived between the timeout and our
+     reacquiring LOCK.  Otherwise we are still on the waiters list
+     and nobody else can take us off it while we hold LOCK. */
+  if (!signaled)
+    {
+      signaled = sema_try_down (&waiter.semaphore);
+      if (!signaled)
+        list_remove (&waiter.elem);
+    }
+  return signaled;
+}
+
 /* If any threads are waiting on COND (protected by LOCK), then
-   this function signals one of them to wake up from its wait.
-   LOCK must be held before calling this function.
+   this function signals the highest-priority one of them to wake
+   up from its wait.  LOCK must be held before calling this
+   function.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to signal a condition variable within an
@@ -317,8 +672,12 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
   ASSERT (lock_held_by_current_thread (lock));
 
   if (!list_empty (&cond->waiters))
-    sema_up (&list_entry (list_pop_front (&cond->waiters),
-                          struct semaphore_elem, elem)->semaphore);
+    {
+      struct list_elem *e = list_max (&cond->waiters,
+                                      waiter_priority_less, NULL);
+      list_remove (e);
+      sema_up (&list_entry (e, struct semaphore_elem, elem)->semaphore);
+    }
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -336,3 +695,101 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   while (!list_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Initializes RW, a readers-writer lock, to be held by no one. */
+void
+rwlock_init (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_init (&rw->lock);
+  cond_init (&rw->readers_ok);
+  cond_init (&rw->writers_ok);
+  rw->readers = 0;
+  rw->waiting_writers = 0;
+  rw->writer = NULL;
+}
+
+/* Acquires RW in read mode, sleeping while a writer holds it or
+   is waiting for it.  The current thread must not already hold
+   RW in either mode: because writers are preferred, a recursive
+   read acquisition can deadlock against a waiting writer.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_read (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!rwlock_held_for_write (rw));
+
+  lock_acquire (&rw->lock);
+  while (rw->writer != NULL || rw->waiting_writers > 0)
+    cond_wait (&rw->readers_ok, &rw->lock);
+  rw->readers++;
+  lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread holds in read mode. */
+void
+rwlock_release_read (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->lock);
+  ASSERT (rw->readers > 0);
+  if (--rw->readers == 0)
+    cond_signal (&rw->writers_ok, &rw->lock);
+  lock_release (&rw->lock);
+}
+
+/* Acquires RW in write mode, sleeping until no reader or other
+   writer holds it.  The current thread must not already hold RW
+   in either mode.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_write (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!rwlock_held_for_write (rw));
+
+  lock_acquire (&rw->lock);
+  rw->waiting_writers++;
+  while (rw->writer != NULL || rw->readers > 0)
+    cond_wait (&rw->writers_ok, &rw->lock);
+  rw->waiting_writers--;
+  rw->writer = thread_current ();
+  lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread holds in write mode.
+   Hands RW to the next waiting writer if there is one, and
+   otherwise admits all waiting readers. */
+void
+rwlock_release_write (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (rwlock_held_for_write (rw));
+
+  lock_acquire (&rw->lock);
+  rw->writer = NULL;
+  if (rw->waiting_writers > 0)
+    cond_signal (&rw->writers_ok, &rw->lock);
+  else
+    cond_broadcast (&rw->readers_ok, &rw->lock);
+  lock_release (&rw->lock);
+}
+
+/* Returns true if the current thread holds RW in write mode,
+   false otherwise. */
+bool
+rwlock_held_for_write (const struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  return rw->writer == thread_current ();
+}
@@ -3,16 +3,41 @@
 
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include "threads/spinlock.h"
+
+/* Contention statistics shared by all locks and semaphores
+   registered under the same name.  Collected only when
+   lock_stat_enabled is true.  Times are in timer ticks. */
+struct lock_stat
+  {
+    const char *name;           /* Name given to lock_set_name(). */
+    unsigned acquires;          /* # of successful acquisitions. */
+    unsigned contended;         /* # of acquisitions that had to wait. */
+    int64_t wait_ticks;         /* Total ticks spent waiting. */
+    int64_t max_wait;           /* Longest single wait. */
+    int64_t max_hold;           /* Longest time a lock was held. */
+  };
+
+/* If true, record lock_stat statistics.
+   Controlled by kernel command-line option "-lockstat". */
+extern bool lock_stat_enabled;
+
+void lock_print_stats (void);
 
 /* A counting semaphore. */
 struct semaphore
   {
+    struct spinlock spin;       /* Protects VALUE and WAITERS. */
     unsigned value;             /* Current value. */
     struct list waiters;        /* List of waiting threads. */
+    struct lock_stat *stat;     /* Statistics, or NULL if unnamed. */
   };
 
 void sema_init (struct semaphore *, unsigned value);
+void sema_set_name (struct semaphore *, const char *name);
 void sema_down (struct semaphore *);
+bool sema_down_timeout (struct semaphore *, int64_t ticks);
 bool sema_try_down (struct semaphore *);
 void sema_up (struct semaphore *);
 void sema_self_test (void);
@@ -22,9 +47,13 @@ struct lock
   {
     struct thread *holder;      /* Thread holding lock (for debugging). */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+    struct list_elem elem;      /* Element in holder's held_locks list. */
+    int max_priority;           /* Highest priority donated by waiters. */
+    int64_t acquired_at;        /* Tick of last acquisition, for stats. */
   };
 
 void lock_init (struct lock *);
+void lock_set_name (struct lock *, const char *name);
 void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
@@ -38,9 +67,31 @@ struct condition
 
 void cond_init (struct condition *);
 void cond_wait (struct condition *, struct lock *);
+bool cond_wait_timeout (struct condition *, struct lock *, int64_t ticks);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Readers-writer lock.  Any number of readers may hold it at
+   once, or a single writer.  Writers are preferred: once a
+   writer is waiting, new readers wait behind it, so a steady
+   stream of readers cannot starve writers. */
+struct rwlock
+  {
+    struct lock lock;           /* Protects the members below. */
+    struct condition readers_ok; /* Signaled when readers may enter. */
+    struct condition writers_ok; /* Signaled when a writer may enter. */
+    int readers;                /* # of threads holding in read mode. */
+    int waiting_writers;        /* # of threads waiting in write mode. */
+    struct thread *writer;      /* Thread holding in write mode. */
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_held_for_write (const struct rwlock *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
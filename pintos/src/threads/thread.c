@@ -4,11 +4,14 @@
 #include <random.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
 #include "filesys/directory.h"
+#include "threads/cpu.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
 #include "threads/palloc.h"
+#include "threads/spinlock.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -21,17 +24,38 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Run queues of processes in THREAD_READY state, that is,
+   processes that are ready to run but not actually running.
+   Each CPU has its own, indexed by its id, and a ready thread T
+   is on the run queue of T->cpu.  A CPU whose run queue is empty
+   steals from the others before it goes idle.
+
+   There is one FIFO queue per priority, and bit P of MASK is set
+   if and only if QUEUES[P] is nonempty, so the highest-priority
+   ready thread is found with a bit scan. */
+struct run_queue
+  {
+    struct list queues[PRI_MAX + 1];
+    uint64_t mask;
+    int cnt;                    /* # of threads in QUEUES. */
+  };
+static struct run_queue run_queues[CPU_MAX];
+
+/* Scheduler lock.  Protects the run queues, the status of every
+   thread, and the `cur' member of every CPU.
+
+   A thread that gives up its CPU acquires it and holds it across
+   switch_threads(), and the thread switched to releases it in
+   thread_schedule_tail().  Thus no other CPU can pick up a
+   thread until its registers are saved, and no thread can be
+   woken until it is fully asleep.  A semaphore's spinlock, if
+   also held, must be acquired first. */
+static struct spinlock sched_lock;
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
 static struct list all_list;
 
-/* Idle thread. */
-static struct thread *idle_thread;
-
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
 
@@ -51,20 +75,73 @@ static long long idle_ticks;    /* # of timer ticks spent idle. */
 static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
 static long long user_ticks;    /* # of timer ticks in user programs. */
 
+/* Pages of exited threads kept for reuse by thread_create(), so
+   that spawning a thread does not have to go back to the page
+   allocator and zero a whole page.  init_thread() clears the
+   struct thread at the bottom of a recycled page; the stack area
+   above it needs no clearing.  Accessed with interrupts off. */
+#define THREAD_PAGE_CACHE_SIZE 16
+static struct thread *page_cache[THREAD_PAGE_CACHE_SIZE];
+static int page_cache_cnt;
+static unsigned page_cache_hits;   /* Pages reused from page_cache. */
+static unsigned page_cache_misses; /* Pages obtained from palloc. */
+
+/* Run-queue wait time histogram: how long threads stayed ready
+   before getting to run.  See THREAD_WAIT_BUCKETS. */
+static unsigned wait_hist[THREAD_WAIT_BUCKETS];
+
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
-static unsigned thread_ticks;   /* # of timer ticks since last yield. */
 
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* MLFQS. */
+#define PRI_RECALC_TICKS 4      /* # of ticks between priority updates. */
+static fixed_point_t load_avg;  /* System load average. */
+
+/* The once-per-second decay of recent_cpu is not applied to every
+   thread when it happens.  Instead, each second starts a new
+   epoch and remembers its decay coefficient, and a thread folds
+   the decays of the epochs it missed into its recent_cpu only
+   when it is next charged a tick, made ready, or asked for its
+   recent_cpu.  Only the last MLFQS_EPOCHS coefficients are kept;
+   a thread that missed more than that decays by the oldest one
+   for the seconds before them. */
+#define MLFQS_EPOCHS 64
+static unsigned mlfqs_epoch;    /* Current epoch. */
+static fixed_point_t decay_coeff[MLFQS_EPOCHS]; /* Indexed by epoch. */
+
+/* Threads whose recent_cpu changed since priorities were last
+   recomputed.  Only these need a new priority on the next
+   recomputation, so its cost is bounded by the number of threads
+   that actually ran rather than by the number of threads in the
+   system. */
+static struct list mlfqs_dirty_list;
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
+static void idle_loop (void) NO_RETURN;
 static struct thread *running_thread (void);
-static struct thread *next_thread_to_run (void);
+static struct thread *next_thread_to_run (struct cpu *);
+static struct run_queue *steal_queue (struct cpu *);
+static struct cpu *cpu_to_kick (struct thread *);
+static bool is_idle (struct thread *);
+static int ready_thread_cnt (void);
+static void ready_push (struct thread *);
+static void ready_remove (struct thread *);
+static struct thread *ready_pop (struct run_queue *);
+static struct thread *thread_page_get (void);
+static void thread_page_put (struct thread *);
+static void mlfqs_tick (struct thread *);
+static bool mlfqs_decay (struct thread *);
+static void mlfqs_mark_dirty (struct thread *);
+static void mlfqs_update_priority (struct thread *);
+static void record_wait (struct thread *);
+static int ready_max_priority (struct run_queue *);
 static void init_thread (struct thread *, const char *name, int priority);
 static bool is_thread (struct thread *) UNUSED;
 static void *alloc_frame (struct thread *, size_t size);
@@ -88,17 +165,31 @@ static tid_t allocate_tid (void);
 void
 thread_init (void)
 {
+  int i, j;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  lock_set_name (&tid_lock, "tid");
+  spin_init (&sched_lock);
+  for (i = 0; i < CPU_MAX; i++)
+    {
+      for (j = 0; j <= PRI_MAX; j++)
+        list_init (&run_queues[i].queues[j]);
+      run_queues[i].mask = 0;
+      run_queues[i].cnt = 0;
+    }
   list_init (&all_list);
+  list_init (&mlfqs_dirty_list);
+  load_avg = fix_int (0);
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
   init_thread (initial_thread, "main", PRI_DEFAULT);
   initial_thread->status = THREAD_RUNNING;
   initial_thread->tid = allocate_tid ();
+  initial_thread->cpu = &cpus[0];
+  cpus[0].cur = initial_thread;
 }
 
 /* Starts preemptive thread scheduling by enabling interrupts.
@@ -114,19 +205,61 @@ thread_start (void)
   /* Start preemptive thread scheduling. */
   intr_enable ();
 
-  /* Wait for the idle thread to initialize idle_thread. */
+  /* Wait for the idle thread to initialize the CPU's idle
+     member. */
   sema_down (&idle_started);
 }
 
+/* Creates the idle thread for CPU, another CPU than the one
+   running, which is not yet started.  The new CPU starts out on
+   the idle thread's stack (see cpu_start_aps()) and then calls
+   thread_start_cpu().  Returns the idle thread, or a null
+   pointer if memory is short. */
+struct thread *
+thread_init_cpu (struct cpu *cpu)
+{
+  char name[16];
+  struct thread *t;
+
+  ASSERT (cpu != cpu_current ());
+
+  t = thread_page_get ();
+  if (t == NULL)
+    return NULL;
+
+  snprintf (name, sizeof name, "idle%d", cpu->id);
+  init_thread (t, name, PRI_MIN);
+  t->tid = allocate_tid ();
+  t->status = THREAD_RUNNING;
+  t->cpu = cpu;
+  cpu->idle = cpu->cur = t;
+  return t;
+}
+
+/* Starts scheduling threads on the running CPU, which must have
+   been set up by thread_init_cpu() and hold the big kernel
+   lock.  Runs the CPU's idle thread and never returns. */
+void
+thread_start_cpu (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (kernel_locked ());
+  ASSERT (is_idle (running_thread ()));
+
+  idle_loop ();
+}
+
 /* Called by the timer interrupt handler at each timer tick.
    Thus, this function runs in an external interrupt context. */
 void
 thread_tick (void)
 {
+  struct cpu *cpu = cpu_current ();
   struct thread *t = thread_current ();
 
   /* Update statistics. */
-  if (t == idle_thread)
+  t->run_ticks++;
+  if (is_idle (t))
     idle_ticks++;
 #ifdef USERPROG
   else if (t->pagedir != NULL)
@@ -135,17 +268,185 @@ thread_tick (void)
   else
     kernel_ticks++;
 
+  if (thread_mlfqs)
+    mlfqs_tick (t);
+
   /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
+  if (++cpu->thread_ticks >= TIME_SLICE)
     intr_yield_on_return ();
 }
 
-/* Prints thread statistics. */
+/* Updates the MLFQS statistics for a timer tick during which T
+   was running.  Runs in an external interrupt context.
+
+   load_avg is recomputed once per second as usual, which starts
+   a new decay epoch, but recent_cpu only decays lazily, and
+   priorities are only recomputed, every PRI_RECALC_TICKS ticks,
+   for the threads on mlfqs_dirty_list.  Every CPU charges the
+   tick to its own running thread, but only the first CPU does
+   the system-wide updates. */
+static void
+mlfqs_tick (struct thread *t)
+{
+  int64_t now = timer_ticks ();
+
+  if (!is_idle (t))
+    {
+      mlfqs_decay (t);
+      t->recent_cpu = fix_add (t->recent_cpu, fix_int (1));
+      mlfqs_mark_dirty (t);
+    }
+
+  if (cpu_current ()->id != 0)
+    return;
+
+  if (now % TIMER_FREQ == 0)
+    {
+      int ready_threads = ready_thread_cnt ();
+
+      load_avg = fix_add (fix_mul (fix_frac (59, 60), load_avg),
+                          fix_scale (fix_frac (1, 60), ready_threads));
+      mlfqs_epoch++;
+      decay_coeff[mlfqs_epoch % MLFQS_EPOCHS]
+        = fix_div (fix_scale (load_avg, 2),
+                   fix_add (fix_scale (load_avg, 2), fix_int (1)));
+    }
+
+  if (now % PRI_RECALC_TICKS == 0)
+    {
+      while (!list_empty (&mlfqs_dirty_list))
+        {
+          struct thread *u = list_entry (list_pop_front (&mlfqs_dirty_list),
+                                         struct thread, mlfqs_elem);
+          u->mlfqs_dirty = false;
+          mlfqs_decay (u);
+          mlfqs_update_priority (u);
+        }
+      thread_preempt ();
+    }
+}
+
+/* Applies to T's recent_cpu the once-per-second decays of the
+   epochs since T's last one.  Returns true if recent_cpu
+   changed.  Interrupts must be off. */
+static bool
+mlfqs_decay (struct thread *t)
+{
+  unsigned missed = mlfqs_epoch - t->mlfqs_epoch;
+  fixed_point_t recent_cpu = t->recent_cpu;
+  fixed_point_t nice = fix_int (t->nice);
+
+  if (missed == 0)
+    return false;
+
+  /* Seconds older than the remembered coefficients decay by the
+     oldest one, until that no longer makes a difference. */
+  if (missed > MLFQS_EPOCHS)
+    {
+      fixed_point_t coeff = decay_coeff[(mlfqs_epoch + 1) % MLFQS_EPOCHS];
+
+      for (; missed > MLFQS_EPOCHS; missed--)
+        {
+          fixed_point_t next = fix_add (fix_mul (coeff, recent_cpu), nice);
+          if (next.f == recent_cpu.f)
+            break;
+          recent_cpu = next;
+        }
+      missed = MLFQS_EPOCHS;
+    }
+
+  for (; missed > 0; missed--)
+    recent_cpu = fix_add (fix_mul (decay_coeff[(mlfqs_epoch - missed + 1)
+                                               % MLFQS_EPOCHS],
+                                   recent_cpu),
+                          nice);
+
+  t->mlfqs_epoch = mlfqs_epoch;
+  if (recent_cpu.f == t->recent_cpu.f)
+    return false;
+  t->recent_cpu = recent_cpu;
+  return true;
+}
+
+/* Queues T for priority recomputation.  Interrupts must be
+   off. */
+static void
+mlfqs_mark_dirty (struct thread *t)
+{
+  if (!t->mlfqs_dirty)
+    {
+      t->mlfqs_dirty = true;
+      list_push_back (&mlfqs_dirty_list, &t->mlfqs_elem);
+    }
+}
+
+/* Sets T's priority from its recent_cpu and nice values, moving
+   it to the matching run queue if it is ready.  Interrupts must
+   be off. */
+static void
+mlfqs_update_priority (struct thread *t)
+{
+  int priority = PRI_MAX - fix_trunc (fix_unscale (t->recent_cpu, 4))
+                 - t->nice * 2;
+
+  if (priority < PRI_MIN)
+    priority = PRI_MIN;
+  else if (priority > PRI_MAX)
+    priority = PRI_MAX;
+
+  t->base_priority = priority;
+  thread_update_priority (t);
+}
+
+/* Prints thread statistics: global tick counts, the run-queue
+   wait time histogram, and the CPU accounting of every thread
+   still alive. */
 void
 thread_print_stats (void)
 {
+  struct list_elem *e;
+  int i;
+
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
           idle_ticks, kernel_ticks, user_ticks);
+  printf ("Thread pages: %u recycled, %u allocated\n",
+          page_cache_hits, page_cache_misses);
+
+  printf ("Run queue wait (ticks:count):");
+  for (i = 0; i < THREAD_WAIT_BUCKETS; i++)
+    printf (" %s%d:%u", i == THREAD_WAIT_BUCKETS - 1 ? ">=" : "",
+            i == 0 ? 0 : 1 << (i - 1), wait_hist[i]);
+  printf ("\n");
+
+  for (e = list_begin (&all_list); e != list_end (&all_list);
+       e = list_next (e))
+    {
+      struct thread *t = list_entry (e, struct thread, allelem);
+      printf ("Thread %d (%s): %lld run ticks, %lld wait ticks, "
+              "%u voluntary and %u involuntary switches\n",
+              t->tid, t->name, t->run_ticks, t->wait_ticks,
+              t->voluntary_switches, t->involuntary_switches);
+    }
+}
+
+/* Copies the run-queue wait time histogram into HIST. */
+void
+thread_get_wait_hist (unsigned hist[THREAD_WAIT_BUCKETS])
+{
+  enum intr_level old_level = intr_disable ();
+  memcpy (hist, wait_hist, sizeof wait_hist);
+  intr_set_level (old_level);
+}
+
+/* Returns the number of timer ticks spent in the idle thread
+   since boot. */
+long long
+thread_get_idle_ticks (void)
+{
+  enum intr_level old_level = intr_disable ();
+  long long t = idle_ticks;
+  intr_set_level (old_level);
+  return t;
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -160,9 +461,9 @@ thread_print_stats (void)
    scheduled.  Use a semaphore or some other form of
    synchronization if you need to ensure ordering.
 
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   If the new thread has a higher priority than the running
+   thread, the running thread yields to it before this function
+   returns. */
 tid_t
 thread_create (const char *name, int priority,
                thread_func *function, void *aux)
@@ -176,7 +477,7 @@ thread_create (const char *name, int priority,
   ASSERT (function != NULL);
 
   /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  t = thread_page_get ();
   if (t == NULL)
     return TID_ERROR;
 
@@ -207,19 +508,83 @@ thread_create (const char *name, int priority,
   return tid;
 }
 
+/* Returns a page for a new thread, preferring one recycled from
+   an exited thread.  Only the struct thread at the bottom of the
+   page is guaranteed to be cleared, by init_thread().  Returns a
+   null pointer if no memory is available. */
+static struct thread *
+thread_page_get (void)
+{
+  struct thread *t = NULL;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  if (page_cache_cnt > 0)
+    {
+      t = page_cache[--page_cache_cnt];
+      page_cache_hits++;
+    }
+  else
+    page_cache_misses++;
+  intr_set_level (old_level);
+
+  if (t == NULL)
+    t = palloc_get_page (0);
+  return t;
+}
+
+/* Releases the page of exited thread T, keeping it for reuse if
+   there is room in the cache. */
+static void
+thread_page_put (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (page_cache_cnt < THREAD_PAGE_CACHE_SIZE)
+    page_cache[page_cache_cnt++] = t;
+  else
+    palloc_free_page (t);
+}
+
 /* Puts the current thread to sleep.  It will not be scheduled
    again until awoken by thread_unblock().
 
-   This function must be called with interrupts turned off.  It
-   is usually a better idea to use one of the synchronization
-   primitives in synch.h. */
+   This function must be called with interrupts turned off.  That
+   keeps the thread from being woken before it is asleep only
+   because every CPU must hold the big kernel lock to run kernel
+   code (see cpu.c).  A caller that protects its list of waiting
+   threads with a spinlock must use thread_block_unlock()
+   instead.  It is usually a better idea to use one of the
+   synchronization primitives in synch.h. */
 void
 thread_block (void)
 {
   ASSERT (!intr_context ());
   ASSERT (intr_get_level () == INTR_OFF);
 
+  spin_lock (&sched_lock);
+  thread_current ()->status = THREAD_BLOCKED;
+  schedule ();
+}
+
+/* Puts the current thread to sleep, like thread_block(), and
+   releases LOCK, which the caller holds and must reacquire after
+   waking if it needs it.
+
+   LOCK is released only once the scheduler lock is held and the
+   thread is marked blocked.  A waker must hold LOCK to find the
+   thread, so it cannot call thread_unblock() any earlier, and
+   thread_unblock() then waits for the scheduler lock until this
+   thread has switched away. */
+void
+thread_block_unlock (struct spinlock *lock)
+{
+  ASSERT (!intr_context ());
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  spin_lock (&sched_lock);
   thread_current ()->status = THREAD_BLOCKED;
+  spin_unlock (lock);
   schedule ();
 }
 
@@ -227,22 +592,41 @@ thread_block (void)
    This is an error if T is not blocked.  (Use thread_yield() to
    make the running thread ready.)
 
-   This function does not preempt the running thread.  This can
-   be important: if the caller had disabled interrupts itself,
-   it may expect that it can atomically unblock a thread and
-   update other data. */
+   T goes on the run queue of the CPU it last ran on.  If that is
+   another CPU running a lower-priority thread, or else if some
+   other CPU is idle, that CPU is interrupted to take T.
+
+   If T has a higher priority than the running thread, the
+   running thread is preempted, but only if the caller had
+   interrupts enabled.  This can be important: if the caller had
+   disabled interrupts itself, it may expect that it can
+   atomically unblock a thread and update other data.  Such a
+   caller should call thread_preempt() once it is done. */
 void
 thread_unblock (struct thread *t)
 {
   enum intr_level old_level;
+  struct cpu *kick;
 
   ASSERT (is_thread (t));
 
   old_level = intr_disable ();
+  if (thread_mlfqs && mlfqs_decay (t))
+    mlfqs_update_priority (t);
+  spin_lock (&sched_lock);
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
+  if (t->cpu == NULL)
+    t->cpu = cpu_current ();
+  ready_push (t);
   t->status = THREAD_READY;
+  t->ready_since = timer_ticks ();
+  kick = cpu_to_kick (t);
+  spin_unlock (&sched_lock);
+  if (kick != NULL)
+    cpu_kick (kick);
   intr_set_level (old_level);
+
+  thread_preempt ();
 }
 
 /* Returns the name of the running thread. */
@@ -294,6 +678,9 @@ thread_exit (void)
      when it calls thread_schedule_tail(). */
   intr_disable ();
   list_remove (&thread_current()->allelem);
+  if (thread_current ()->mlfqs_dirty)
+    list_remove (&thread_current ()->mlfqs_elem);
+  spin_lock (&sched_lock);
   thread_current ()->status = THREAD_DYING;
   schedule ();
   NOT_REACHED ();
@@ -310,13 +697,54 @@ thread_yield (void)
   ASSERT (!intr_context ());
 
   old_level = intr_disable ();
-  if (cur != idle_thread)
-    list_push_back (&ready_list, &cur->elem);
+  spin_lock (&sched_lock);
+  if (!is_idle (cur))
+    ready_push (cur);
   cur->status = THREAD_READY;
+  cur->ready_since = timer_ticks ();
   schedule ();
   intr_set_level (old_level);
 }
 
+/* Yields the CPU if a ready thread on its run queue has a higher
+   priority than the running thread, or if the CPU is idle and
+   any thread is ready.  Within an external interrupt handler,
+   the yield happens when the handler returns.
+
+   Does nothing if called with interrupts disabled outside an
+   interrupt handler, since the caller may be relying on running
+   atomically.  It should call this function again once it has
+   re-enabled interrupts. */
+void
+thread_preempt (void)
+{
+  struct thread *cur;
+  struct run_queue *rq;
+  enum intr_level old_level;
+  bool should_yield;
+
+  if (!intr_context () && intr_get_level () == INTR_OFF)
+    return;
+
+  old_level = intr_disable ();
+  spin_lock (&sched_lock);
+  cur = running_thread ();
+  rq = &run_queues[cur->cpu->id];
+  if (rq->mask != 0)
+    should_yield = is_idle (cur) || ready_max_priority (rq) > cur->priority;
+  else
+    should_yield = is_idle (cur) && steal_queue (cur->cpu) != NULL;
+  spin_unlock (&sched_lock);
+  intr_set_level (old_level);
+
+  if (!should_yield)
+    return;
+  if (intr_context ())
+    intr_yield_on_return ();
+  else
+    thread_yield ();
+}
+
 /* Invoke function 'func' on all threads, passing along 'aux'.
    This function must be called with interrupts off. */
 void
@@ -334,11 +762,67 @@ thread_foreach (thread_action_func *func, void *aux)
     }
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Sets the current thread's base priority to NEW_PRIORITY and
+   yields if it no longer has the highest priority.  Priority
+   donated to the thread through the locks it holds still
+   applies on top of NEW_PRIORITY. */
 void
 thread_set_priority (int new_priority)
 {
-  thread_current ()->priority = new_priority;
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (PRI_MIN <= new_priority && new_priority <= PRI_MAX);
+
+  /* The MLFQS computes priorities on its own. */
+  if (thread_mlfqs)
+    return;
+
+  old_level = intr_disable ();
+  cur->base_priority = new_priority;
+  thread_update_priority (cur);
+  intr_set_level (old_level);
+
+  thread_preempt ();
+}
+
+/* Recomputes T's effective priority as the maximum of its base
+   priority and the priorities donated through each lock it
+   holds, moving T to the matching run queue if it is ready.
+   This only looks at T's own held locks, whose max_priority
+   members synch.c keeps up to date.  Interrupts must be off. */
+void
+thread_update_priority (struct thread *t)
+{
+  struct list_elem *e;
+  struct cpu *kick = NULL;
+  int priority = t->base_priority;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (e = list_begin (&t->held_locks); e != list_end (&t->held_locks);
+       e = list_next (e))
+    {
+      struct lock *lock = list_entry (e, struct lock, elem);
+      if (lock->max_priority > priority)
+        priority = lock->max_priority;
+    }
+
+  if (priority == t->priority)
+    return;
+  spin_lock (&sched_lock);
+  if (t->status == THREAD_READY)
+    {
+      ready_remove (t);
+      t->priority = priority;
+      ready_push (t);
+      kick = cpu_to_kick (t);
+    }
+  else
+    t->priority = priority;
+  spin_unlock (&sched_lock);
+  if (kick != NULL)
+    cpu_kick (kick);
 }
 
 /* Returns the current thread's priority. */
@@ -348,60 +832,96 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE, recomputes its
+   priority and yields if it no longer has the highest
+   priority. */
 void
-thread_set_nice (int nice UNUSED)
+thread_set_nice (int nice)
 {
-  /* Not yet implemented. */
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+  old_level = intr_disable ();
+  if (thread_mlfqs)
+    mlfqs_decay (cur);
+  cur->nice = nice;
+  if (thread_mlfqs)
+    mlfqs_update_priority (cur);
+  intr_set_level (old_level);
+
+  thread_preempt ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int load_avg_100 = fix_round (fix_scale (load_avg, 100));
+  intr_set_level (old_level);
+  return load_avg_100;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  struct thread *cur = thread_current ();
+  enum intr_level old_level = intr_disable ();
+  int recent_cpu_100;
+
+  if (mlfqs_decay (cur))
+    mlfqs_mark_dirty (cur);
+  recent_cpu_100 = fix_round (fix_scale (cur->recent_cpu, 100));
+  intr_set_level (old_level);
+  return recent_cpu_100;
 }
 
-/* Idle thread.  Executes when no other thread is ready to run.
+/* Idle thread of the first CPU.  Executes when no other thread
+   is ready to run.
 
    The idle thread is initially put on the ready list by
    thread_start().  It will be scheduled once initially, at which
-   point it initializes idle_thread, "up"s the semaphore passed
-   to it to enable thread_start() to continue, and immediately
-   blocks.  After that, the idle thread never appears in the
-   ready list.  It is returned by next_thread_to_run() as a
-   special case when the ready list is empty. */
+   point it initializes the CPU's idle member, "up"s the
+   semaphore passed to it to enable thread_start() to continue,
+   and immediately blocks.  After that, the idle thread never
+   appears in the ready list.  It is returned by
+   next_thread_to_run() as a special case when there is no
+   thread to run.  The other CPUs' idle threads are created by
+   thread_init_cpu() and start out running. */
 static void
 idle (void *idle_started_ UNUSED)
 {
   struct semaphore *idle_started = idle_started_;
-  idle_thread = thread_current ();
+  cpu_current ()->idle = thread_current ();
   sema_up (idle_started);
 
+  idle_loop ();
+}
+
+/* Body of every CPU's idle thread. */
+static void
+idle_loop (void)
+{
   for (;;)
     {
       /* Let someone else run. */
       intr_disable ();
       thread_block ();
 
-      /* Re-enable interrupts and wait for the next one.
+      /* Let other CPUs into the kernel while we wait.  Any
+         interrupt takes the big kernel lock for its handler.
+
+         Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
          completion of the next instruction, so these two
@@ -413,7 +933,10 @@ idle (void *idle_started_ UNUSED)
 
          See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
          7.11.1 "HLT Instruction". */
+      kernel_unlock ();
       asm volatile ("sti; hlt" : : : "memory");
+      intr_disable ();
+      kernel_lock ();
     }
 }
 
@@ -465,14 +988,29 @@ init_thread (struct thread *t, const char *name, int priority)
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
   t->priority = priority;
+  t->base_priority = priority;
   t->magic = THREAD_MAGIC;
 
+  list_init (&t->held_locks);
+
   list_init (&t->child_status_list);
 
   list_init (&t->fd_list);
   t->next_fd_num = 2;
 
   old_level = intr_disable ();
+
+  /* Under the MLFQS a thread inherits its parent's niceness and
+     recent CPU time, and its priority follows from those. */
+  if (thread_mlfqs && t != running_thread ())
+    {
+      struct thread *parent = thread_current ();
+      t->nice = parent->nice;
+      t->recent_cpu = parent->recent_cpu;
+      t->mlfqs_epoch = parent->mlfqs_epoch;
+      mlfqs_update_priority (t);
+    }
+
   list_push_back (&all_list, &t->allelem);
   intr_set_level (old_level);
 }
@@ -490,18 +1028,151 @@ alloc_frame (struct thread *t, size_t size)
   return t->stack;
 }
 
-/* Chooses and returns the next thread to be scheduled.  Should
-   return a thread from the run queue, unless the run queue is
-   empty.  (If the running thread can continue running, then it
-   will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+/* Adds T to the back of the queue for its priority in the run
+   queue of T->cpu.  sched_lock must be held. */
+static void
+ready_push (struct thread *t)
+{
+  struct run_queue *rq = &run_queues[t->cpu->id];
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  list_push_back (&rq->queues[t->priority], &t->elem);
+  rq->mask |= (uint64_t) 1 << t->priority;
+  rq->cnt++;
+}
+
+/* Removes ready thread T from its run queue.
+   sched_lock must be held. */
+static void
+ready_remove (struct thread *t)
+{
+  struct run_queue *rq = &run_queues[t->cpu->id];
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->status == THREAD_READY);
+
+  list_remove (&t->elem);
+  if (list_empty (&rq->queues[t->priority]))
+    rq->mask &= ~((uint64_t) 1 << t->priority);
+  rq->cnt--;
+}
+
+/* Removes and returns the thread at the front of the
+   highest-priority nonempty queue in RQ, which takes constant
+   time regardless of the number of ready threads.  RQ must not
+   be empty.  sched_lock must be held. */
 static struct thread *
-next_thread_to_run (void)
+ready_pop (struct run_queue *rq)
 {
-  if (list_empty (&ready_list))
-    return idle_thread;
+  int priority = ready_max_priority (rq);
+  struct list *queue = &rq->queues[priority];
+  struct thread *t = list_entry (list_pop_front (queue), struct thread, elem);
+
+  if (list_empty (queue))
+    rq->mask &= ~((uint64_t) 1 << priority);
+  rq->cnt--;
+  return t;
+}
+
+/* Returns the highest priority of any ready thread in RQ.  At
+   least one thread must be ready.  sched_lock must be held. */
+static int
+ready_max_priority (struct run_queue *rq)
+{
+  uint32_t high = rq->mask >> 32;
+
+  ASSERT (rq->mask != 0);
+
+  if (high != 0)
+    return 63 - __builtin_clz (high);
   else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+    return 31 - __builtin_clz ((uint32_t) rq->mask);
+}
+
+/* Returns the number of threads running or ready to run, not
+   counting idle threads. */
+static int
+ready_thread_cnt (void)
+{
+  int cnt = 0;
+  int i;
+
+  spin_lock (&sched_lock);
+  for (i = 0; i < cpu_cnt; i++)
+    {
+      cnt += run_queues[i].cnt;
+      if (cpus[i].started && !is_idle (cpus[i].cur))
+        cnt++;
+    }
+  spin_unlock (&sched_lock);
+  return cnt;
+}
+
+/* Returns true if T is the idle thread of its CPU. */
+static bool
+is_idle (struct thread *t)
+{
+  return t->cpu != NULL && t == t->cpu->idle;
+}
+
+/* Returns the run queue, other than CPU's own, with the
+   highest-priority ready thread, or a null pointer if all the
+   others are empty.  sched_lock must be held. */
+static struct run_queue *
+steal_queue (struct cpu *cpu)
+{
+  struct run_queue *best = NULL;
+  int i;
+
+  for (i = 0; i < cpu_cnt; i++)
+    {
+      struct run_queue *rq = &run_queues[i];
+      if (i != cpu->id && rq->mask != 0
+          && (best == NULL
+              || ready_max_priority (rq) > ready_max_priority (best)))
+        best = rq;
+    }
+  return best;
+}
+
+/* Returns the CPU other than the running one, if any, that
+   should be interrupted to run T, which was just put on its run
+   queue: T's own CPU, if T has a higher priority than the thread
+   running there, or else an idle CPU, which will steal T.
+   sched_lock must be held. */
+static struct cpu *
+cpu_to_kick (struct thread *t)
+{
+  struct cpu *self = cpu_current ();
+  struct cpu *target = t->cpu;
+  int i;
+
+  if (is_idle (target->cur) || t->priority > target->cur->priority)
+    return target != self ? target : NULL;
+
+  for (i = 0; i < cpu_cnt; i++)
+    if (&cpus[i] != self && cpus[i].started && is_idle (cpus[i].cur))
+      return &cpus[i];
+  return NULL;
+}
+
+/* Chooses and returns the next thread for CPU to run.  Should
+   return a thread from CPU's run queue, unless it is empty.  (If
+   the running thread can continue running, then it will be in
+   the run queue.)  If it is empty, steals the highest-priority
+   thread from another CPU's run queue, and if all of them are
+   empty, returns CPU's idle thread.  sched_lock must be held. */
+static struct thread *
+next_thread_to_run (struct cpu *cpu)
+{
+  struct run_queue *rq = &run_queues[cpu->id];
+
+  if (rq->mask == 0)
+    rq = steal_queue (cpu);
+  if (rq == NULL)
+    return cpu->idle;
+  return ready_pop (rq);
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -509,7 +1180,8 @@ next_thread_to_run (void)
 
    At this function's invocation, we just switched from thread
    PREV, the new thread is already running, and interrupts are
-   still disabled.  This function is normally invoked by
+   still disabled.  The scheduler lock is still held, and this
+   function releases it.  This function is normally invoked by
    thread_schedule() as its final action before returning, but
    the first time a thread is scheduled it is called by
    switch_entry() (see switch.S).
@@ -524,14 +1196,21 @@ void
 thread_schedule_tail (struct thread *prev)
 {
   struct thread *cur = running_thread ();
+  struct cpu *cpu = cur->cpu;
 
   ASSERT (intr_get_level () == INTR_OFF);
 
   /* Mark us as running. */
   cur->status = THREAD_RUNNING;
+  cpu->cur = cur;
+  if (!is_idle (cur))
+    record_wait (cur);
 
   /* Start new time slice. */
-  thread_ticks = 0;
+  cpu->thread_ticks = 0;
+
+  /* PREV's registers are saved, so other CPUs may now take it. */
+  spin_unlock (&sched_lock);
 
 #ifdef USERPROG
   /* Activate the new address space. */
@@ -546,33 +1225,60 @@ thread_schedule_tail (struct thread *prev)
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread)
     {
       ASSERT (prev != cur);
-      palloc_free_page (prev);
+      thread_page_put (prev);
     }
 }
 
-/* Schedules a new process.  At entry, interrupts must be off and
-   the running process's state must have been changed from
-   running to some other state.  This function finds another
-   thread to run and switches to it.
+/* Schedules a new process.  At entry, interrupts must be off,
+   the scheduler lock must be held, and the running process's
+   state must have been changed from running to some other state.
+   This function finds another thread to run and switches to it.
 
    It's not safe to call printf() until thread_schedule_tail()
    has completed. */
 static void
 schedule (void)
 {
+  struct cpu *cpu = cpu_current ();
   struct thread *cur = running_thread ();
-  struct thread *next = next_thread_to_run ();
+  struct thread *next = next_thread_to_run (cpu);
   struct thread *prev = NULL;
 
   ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (sched_lock.locked);
   ASSERT (cur->status != THREAD_RUNNING);
   ASSERT (is_thread (next));
 
+  next->cpu = cpu;
   if (cur != next)
-    prev = switch_threads (cur, next);
+    {
+      if (cur->status == THREAD_READY)
+        cur->involuntary_switches++;
+      else
+        cur->voluntary_switches++;
+      prev = switch_threads (cur, next);
+    }
   thread_schedule_tail (prev);
 }
 
+/* Charges the time T spent on the run queue, from when it last
+   became ready until now, to T and to the wait time histogram.
+   Interrupts must be off. */
+static void
+record_wait (struct thread *t)
+{
+  int64_t wait = timer_ticks () - t->ready_since;
+  int bucket = 0;
+
+  t->wait_ticks += wait;
+  while (wait > 0 && bucket < THREAD_WAIT_BUCKETS - 1)
+    {
+      wait >>= 1;
+      bucket++;
+    }
+  wait_hist[bucket]++;
+}
+
 /* Returns a tid to use for a new thread. */
 static tid_t
 allocate_tid (void)
@@ -7,6 +7,8 @@
 #include "threads/synch.h"
 #include "threads/fixed-point.h"
 
+struct cpu;
+
 /* States in a thread's life cycle. */
 enum thread_status
   {
@@ -26,6 +28,17 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Number of buckets in the run-queue wait time histogram.
+   Bucket 0 counts waits of 0 ticks, bucket B > 0 counts waits of
+   2**(B-1) to 2**B - 1 ticks, and the last bucket also counts
+   every longer wait. */
+#define THREAD_WAIT_BUCKETS 12
+
+/* Thread niceness, used by the MLFQS. */
+#define NICE_MIN -20                    /* Nicest. */
+#define NICE_DEFAULT 0                  /* Default niceness. */
+#define NICE_MAX 20                     /* Least nice. */
+
 struct exit_status_t
   {
     int exit_code;                      /* Child’s exit code. */
@@ -104,10 +117,11 @@ struct fd_t
    value, triggering the assertion. */
 /* The `elem' member has a dual purpose.  It can be an element in
    the run queue (thread.c), or it can be an element in a
-   semaphore wait list (synch.c).  It can be used these two ways
-   only because they are mutually exclusive: only a thread in the
-   ready state is on the run queue, whereas only a thread in the
-   blocked state is on a semaphore wait list. */
+   semaphore wait list (synch.c) or the sleeping list (timer.c).
+   It can be used these ways only because they are mutually
+   exclusive: only a thread in the ready state is on the run
+   queue, whereas only a thread in the blocked state is on a
+   semaphore wait list or the sleeping list, and never both. */
 struct thread
   {
     /* Owned by thread.c. */
@@ -115,8 +129,10 @@ struct thread
     enum thread_status status;          /* Thread state. */
     char name[16];                      /* Name (for debugging purposes). */
     uint8_t *stack;                     /* Saved stack pointer. */
-    int priority;                       /* Priority. */
+    int priority;                       /* Effective priority. */
+    int base_priority;                  /* Priority before donations. */
     struct list_elem allelem;           /* List element for all threads list. */
+    struct cpu *cpu;                    /* CPU running it, or that last did. */
 
     struct exit_status_t *exit_status;
     struct list child_status_list;
@@ -128,8 +144,29 @@ struct thread
 
     struct dir *cwd;                    /* Current working directory. */
 
+    /* MLFQS state, owned by thread.c. */
+    int nice;                           /* Niceness. */
+    fixed_point_t recent_cpu;           /* Recent CPU time received. */
+    unsigned mlfqs_epoch;               /* Last decay epoch applied to
+                                           recent_cpu. */
+    bool mlfqs_dirty;                   /* recent_cpu changed since the
+                                           last priority recomputation? */
+    struct list_elem mlfqs_elem;        /* Element in mlfqs_dirty_list. */
+
+    /* Scheduler statistics, owned by thread.c. */
+    int64_t run_ticks;                  /* Timer ticks spent running. */
+    int64_t wait_ticks;                 /* Timer ticks spent ready. */
+    int64_t ready_since;                /* Tick it last became ready. */
+    unsigned voluntary_switches;        /* Switched out by blocking. */
+    unsigned involuntary_switches;      /* Switched out while runnable. */
+
+    /* Owned by devices/timer.c. */
+    int64_t wakeup_time;                /* Tick to wake up at in timer_sleep(). */
+
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
+    struct lock *waiting_lock;          /* Lock being waited for, if any. */
+    struct list held_locks;             /* Locks held, for donation. */
 
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
@@ -147,14 +184,19 @@ extern bool thread_mlfqs;
 
 void thread_init (void);
 void thread_start (void);
+struct thread *thread_init_cpu (struct cpu *);
+void thread_start_cpu (void) NO_RETURN;
 
 void thread_tick (void);
 void thread_print_stats (void);
+long long thread_get_idle_ticks (void);
+void thread_get_wait_hist (unsigned hist[THREAD_WAIT_BUCKETS]);
 
 typedef void thread_func (void *aux);
 tid_t thread_create (const char *name, int priority, thread_func *, void *);
 
 void thread_block (void);
+void thread_block_unlock (struct spinlock *);
 void thread_unblock (struct thread *);
 
 struct thread *thread_current (void);
@@ -163,6 +205,7 @@ const char *thread_name (void);
 
 void thread_exit (void) NO_RETURN;
 void thread_yield (void);
+void thread_preempt (void);
 
 /* Performs some operation on thread t, given auxiliary data AUX. */
 typedef void thread_action_func (struct thread *t, void *aux);
@@ -170,6 +213,7 @@ void thread_foreach (thread_action_func *, void *);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
+void thread_update_priority (struct thread *);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
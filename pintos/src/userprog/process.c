@@ -12,6 +12,7 @@
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "threads/cpu.h"
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
@@ -116,7 +117,10 @@ start_process (void *exec_status_)
      threads/intr-stubs.S).  Because intr_exit takes all of its
      arguments on the stack in the form of a `struct intr_frame',
      we just point the stack pointer (%esp) to our stack frame
-     and jump to it. */
+     and jump to it.  Like a real return from an interrupt into
+     user code, this lets other CPUs into the kernel. */
+  intr_disable ();
+  kernel_unlock ();
   asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
   NOT_REACHED ();
 }
@@ -142,6 +146,7 @@ process_exit (void)
 {
   struct thread *cur = thread_current ();
   uint32_t *pd;
+  int ref_count;
 
   /* Close all opened files and directories. */
   while (!list_empty (&cur->fd_list))
@@ -158,6 +163,34 @@ process_exit (void)
   /* Close executable. */
   file_close (cur->executable);
 
+  /* Only now wake a waiting parent, which may go on to shut down
+     the file system, perhaps on another CPU.  Decrement self
+     REF_COUNT and try to free self EXIT_STATUS.  Its lock must be
+     released first, because a held lock is on the holder's list
+     of held locks.  Kernel threads have no EXIT_STATUS. */
+  if (cur->exit_status != NULL)
+    {
+      lock_acquire (&cur->exit_status->lock);
+      ref_count = --cur->exit_status->ref_count;
+      if (ref_count != 0)
+        sema_up (&cur->exit_status->sema);
+      lock_release (&cur->exit_status->lock);
+      if (ref_count == 0)
+        free (cur->exit_status);
+    }
+
+  /* Decrement REF_COUNT of all children and try to free child's EXIT_STATUS. */
+  while (!list_empty (&cur->child_status_list))
+    {
+      struct list_elem *e = list_pop_front (&cur->child_status_list);
+      struct exit_status_t *exit_status = list_entry (e, struct exit_status_t, elem);
+      lock_acquire (&exit_status->lock);
+      ref_count = --exit_status->ref_count;
+      lock_release (&exit_status->lock);
+      if (ref_count == 0)
+        free (exit_status);
+    }
+
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
   pd = cur->pagedir;
@@ -4,10 +4,12 @@
 #include <syscall-nr.h>
 #include "devices/input.h"
 #include "devices/shutdown.h"
+#include "devices/timer.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/inode.h"
 #include "userprog/pagedir.h"
 #include "userprog/process.h"
 #include "threads/interrupt.h"
@@ -16,6 +18,10 @@
 #include "threads/vaddr.h"
 #include "filesys/cache.h"
 
+#if SCHED_WAIT_BUCKETS != THREAD_WAIT_BUCKETS
+#error SCHED_WAIT_BUCKETS must match THREAD_WAIT_BUCKETS
+#endif
+
 static void syscall_handler (struct intr_frame *);
 static int validate_addr (void *addr);
 static void validate_args (void *esp, int argc);
@@ -44,30 +50,9 @@ sys_exit (int status)
 {
   struct thread *cur = thread_current ();
 
+  /* process_exit() hands the code to the parent once the
+     process's files are closed. */
   cur->exit_status->exit_code = status;
-
-  /* Decrement self REF_COUNT and try to free self EXIT_STATUS. */
-  lock_acquire (&cur->exit_status->lock);
-  cur->exit_status->ref_count--;
-  if (cur->exit_status->ref_count == 0)
-    free (cur->exit_status);
-  else
-    sema_up (&cur->exit_status->sema);
-  lock_release (&cur->exit_status->lock);
-
-  /* Decrement REF_COUNT of all children and try to free child's EXIT_STATUS. */
-  while (!list_empty (&cur->child_status_list))
-    {
-      struct list_elem *e = list_pop_front (&cur->child_status_list);
-      struct exit_status_t *exit_status = list_entry (e, struct exit_status_t, elem);
-      lock_acquire (&exit_status->lock);
-      exit_status->ref_count--;
-      if (exit_status->ref_count == 0)
-        free (exit_status);
-      else
-        lock_release (&exit_status->lock);
-    }
-
   printf ("%s: exit(%d)\n", (char *) &cur->name, status);
   thread_exit ();
 }
@@ -93,13 +78,13 @@ sys_wait (pid_t pid)
           sema_down (&exit_status->sema);
 
           int exit_code = exit_status->exit_code;
+          int ref_count;
 
           lock_acquire (&exit_status->lock);
-          exit_status->ref_count--;
-          if (exit_status->ref_count == 0)
+          ref_count = --exit_status->ref_count;
+          lock_release (&exit_status->lock);
+          if (ref_count == 0)
             free (exit_status);
-          else
-            lock_release (&exit_status->lock);
 
           return exit_code;
         }
@@ -315,7 +300,7 @@ bool sys_mkdir (const char *path)
   if ((dir = dir_resolve (dir_path)) != NULL)
     {
       sector = 0;
-      if (free_map_calloc (&sector)
+      if (free_map_calloc (dir_inumber (dir), 1, &sector, CACHE_INODE)
           && dir_create (sector, dir_inumber (dir))
           && dir_add (dir, target, sector, true))
         success = true;
@@ -323,7 +308,7 @@ bool sys_mkdir (const char *path)
     }
 
   if (!success && sector != 0)
-    free_map_release (sector);
+    free_map_release (sector, 1);
 
   free (dir_path);
   free (target);
@@ -380,6 +365,68 @@ int sys_inumber (int fd_num)
   return -1;
 }
 
+/* Returns the number of runs of consecutive sectors that hold the
+   data of the file open as FD_NUM, or -1 if it is not an open
+   file. */
+int sys_fragments (int fd_num)
+{
+  struct thread *cur = thread_current ();
+  struct list_elem *e;
+  for (e = list_begin (&cur->fd_list); e != list_end (&cur->fd_list); e = list_next (e))
+    {
+      struct fd_t *fd = list_entry (e, struct fd_t, elem);
+      if (fd->num == fd_num && !fd->is_dir)
+        {
+          struct file *file = fd->ptr;
+          size_t sectors;
+          return (int) inode_fragments (file_get_inode (file), &sectors);
+        }
+    }
+  return -1;
+}
+
+void
+sys_sched_stats (struct sched_stats *stats)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  stats->run_ticks = cur->run_ticks;
+  stats->wait_ticks = cur->wait_ticks;
+  stats->voluntary_switches = cur->voluntary_switches;
+  stats->involuntary_switches = cur->involuntary_switches;
+  intr_set_level (old_level);
+
+  thread_get_wait_hist (stats->wait_hist);
+}
+
+void
+sys_cache_stats (struct cache_stats *stats)
+{
+  int i;
+
+  /* CACHE_CLASS_CNT is an enumerator, so this cannot be checked by
+     the preprocessor. */
+  ASSERT (CACHE_STAT_CLASSES == CACHE_CLASS_CNT);
+
+  for (i = 0; i < CACHE_CLASS_CNT; i++)
+    {
+      struct cache_class_stats cs;
+
+      get_class_stats (i, &cs);
+      stats->classes[i].sectors = cs.sectors;
+      stats->classes[i].dirty = cs.dirty;
+      stats->classes[i].hits = cs.hits;
+      stats->classes[i].readahead_hits = cs.readahead_hits;
+      stats->classes[i].misses = cs.misses;
+      stats->classes[i].evictions = cs.evictions;
+      stats->classes[i].writebacks = cs.writebacks;
+      stats->classes[i].miss_ticks = cs.misses > 0
+                                     ? cs.miss_ticks / cs.misses : 0;
+    }
+}
+
 
 static void
 syscall_handler (struct intr_frame *f)
@@ -509,6 +556,39 @@ syscall_handler (struct intr_frame *f)
         cache_reset ();
       break;
 
+      case SYS_SCHED_STATS:
+        validate_args (f->esp, 1);
+      for (i = 0; validate_addr ((void *) args[1] + i)
+                  && i < sizeof (struct sched_stats); ++i);
+      sys_sched_stats ((struct sched_stats *) args[1]);
+      break;
+
+      case SYS_READ_CNT:
+        f->eax = (unsigned) get_fs_device_read_cnt ();
+      break;
+
+      case SYS_CACHE_STATS:
+        validate_args (f->esp, 1);
+      for (i = 0; validate_addr ((void *) args[1] + i)
+                  && i < sizeof (struct cache_stats); ++i);
+      sys_cache_stats ((struct cache_stats *) args[1]);
+      break;
+
+      case SYS_FRAGMENTS:
+        validate_args (f->esp, 1);
+      f->eax = sys_fragments ((int) args[1]);
+      break;
+
+      case SYS_TICKS:
+        f->eax = (unsigned) timer_ticks ();
+      break;
+
+      case SYS_CACHE_REPLAY:
+        validate_args (f->esp, 1);
+      for (ptr = (char *) args[1]; validate_addr (ptr) && *ptr != '\0'; ++ptr);
+      f->eax = cache_replay ((const char *) args[1]);
+      break;
+
       default:
         sys_exit (-1);
     }
@@ -26,5 +26,9 @@ bool sys_mkdir (const char *);
 bool sys_readdir (int, char *);
 bool sys_isdir (int);
 int sys_inumber (int);
+int sys_fragments (int);
+
+void sys_sched_stats (struct sched_stats *);
+void sys_cache_stats (struct cache_stats *);
 
 #endif /* userprog/syscall.h */